@@ -10,18 +10,29 @@ form without prior written permission from LumenRadio AB.
 #include <string.h>
 
 #include "large_packet.h"
+#include "lp_ack.h"
+#include "lp_budget.h"
+#include "lp_dispatch.h"
 #include "lp_events.h"
+#include "lp_prof.h"
 #include "lp_request.h"
+#include "lp_rxrules.h"
 #include "lp_signal.h"
 #include "lp_subpacket.h"
+#include "lp_subscription.h"
+#include "lp_timer.h"
 
 #define DEBUG_LEVEL 2
 #include "utils.h"
 
+#define LPTR_MODULE LPTR_MODULE_LP
+#include "lp_trace.h"
+
 // ******************************************************************************
 // Global variables
 // ******************************************************************************
 process_event_t event_lp_received;
+process_event_t event_lp_sent;
 
 // ******************************************************************************
 // Module types
@@ -32,12 +43,39 @@ typedef struct {
     uint8_t const *payload;
 } sub_packet_t;
 
+/* Pacing of a transmission, adapted to the backpressure of the TX queue */
+typedef struct {
+    uint32_t period_ms; /* at least the requested period */
+    uint8_t n_queue_full; /* consecutive transmissions with TX queue full */
+} pacing_t;
+
 // ******************************************************************************
 // Module constants
 // ******************************************************************************
 
-/* Max number of times to request re-transmission of missing sub-packets. */
-#define LP_MAX_NUM_RETRANSMISSION_REQUESTS (4)
+/* Time for the sender to wait for the completion acknowledgement after the
+ * last sub-packet, in sub-packet periods. Longer than the receiver's time-out,
+ * so that a new request for missing sub-packets arrives first. */
+#define LP_COMPLETION_ACK_WAIT_PERIODS (12)
+
+/* Max number of multicast repair rounds, after the first round. */
+#define LP_MULTICAST_MAX_REPAIR_ROUNDS (8)
+
+/* Time to collect reports of missing sub-packets after a multicast round, in
+ * sub-packet periods. Must exceed the receivers' time-out, including jitter
+ * (see large_packet_receive_proc). */
+#define LP_MULTICAST_NACK_WINDOW_PERIODS (12)
+
+/* Max number of consecutive sub-packet transmissions failing on a full TX
+ * queue, before giving up the transfer. */
+#define LP_QUEUE_FULL_MAX_RETRIES (16)
+
+/* The pacing period doubles at each full TX queue, up to this factor of the
+ * requested period. */
+#define LP_PACING_MAX_FACTOR (8)
+
+/* Backoff used on a full TX queue when no period is requested */
+#define LP_PACING_MIN_BACKOFF_MS (10)
 
 /* Inject faults for testing re-transmissions */
 #ifndef FAULT_RATE_PERCENT
@@ -49,16 +87,48 @@ typedef struct {
 // ******************************************************************************
 static mira_net_udp_connection_t *large_packet_udp_connection;
 static bool large_packet_currently_sending = false;
+/* Destination and large packets of large_packet_announce_proc */
+static mira_net_address_t large_packet_announce_dst;
+static large_packet_t *large_packet_announced[LPSIG_BATCH_MAX_ENTRIES];
+static uint8_t large_packet_n_announced;
+/* Set by push_start() for the transfer it starts, see large_packet_send_proc */
+static bool large_packet_push_started;
+/* Slot of the last reception prepared, see large_packet_receive_prepare() */
+static large_packet_t *large_packet_rx_ongoing;
 
 // ******************************************************************************
 // Function prototypes
 // ******************************************************************************
 PROCESS(large_packet_send_proc, "Sending of large packets");
 PROCESS(large_packet_receive_proc, "Receive sub-packets for large packet");
+PROCESS(large_packet_multicast_proc, "Multicast distribution of large packets");
+PROCESS(large_packet_announce_proc, "Announcement of large packets");
 
 static void request_for_missing_subpackets(
     const large_packet_t *lp);
 
+static void announce_reply_handle(
+    bool *replied,
+    uint8_t *n_replied,
+    process_event_t ev,
+    process_data_t data);
+
+static void announce_signal_send(
+    const bool *replied);
+
+static void multicast_nack_merge(
+    const large_packet_t *lp,
+    uint64_t *nack_mask,
+    process_event_t ev,
+    process_data_t data);
+
+static void send_feedback_handle(
+    large_packet_t *lp,
+    uint64_t *acked_mask,
+    bool *cancelled,
+    process_event_t ev,
+    process_data_t data);
+
 static void large_packet_udp_listen_callback(
     mira_net_udp_connection_t *connection,
     const void *data,
@@ -69,6 +139,17 @@ static void large_packet_udp_listen_callback(
 static int next_sub_packet_send(
     large_packet_t *large_packet);
 
+static int pacing_update(
+    const large_packet_t *lp,
+    pacing_t *pacing,
+    int status);
+
+static int push_start(
+    large_packet_t *large_packet,
+    const mira_net_address_t *dst,
+    uint16_t period_ms,
+    uint8_t flags);
+
 static sub_packet_t pick_next_to_send(
     const large_packet_t *lp);
 
@@ -115,6 +196,20 @@ int large_packet_init(
         return -1;
     }
 
+    lpprof_init();
+
+    if (lpb_init() < 0) {
+        P_ERR("%s: lpb_init\n", __func__);
+        return -1;
+    }
+    if (lpt_init() < 0) {
+        P_ERR("%s: lpt_init\n", __func__);
+        return -1;
+    }
+    if (lpd_init() < 0) {
+        P_ERR("%s: lpd_init\n", __func__);
+        return -1;
+    }
     if (lpsig_init(large_packet_udp_connection) < 0) {
         P_ERR("%s: lpsig_init\n", __func__);
         return -1;
@@ -127,10 +222,19 @@ int large_packet_init(
         P_ERR("%s: lpsp_init\n", __func__);
         return -1;
     }
+    if (lpack_init(large_packet_udp_connection) < 0) {
+        P_ERR("%s: lpack_init\n", __func__);
+        return -1;
+    }
+    if (lpsub_init(large_packet_udp_connection) < 0) {
+        P_ERR("%s: lpsub_init\n", __func__);
+        return -1;
+    }
 
     large_packet_currently_sending = false;
 
     event_lp_received = process_alloc_event();
+    event_lp_sent = process_alloc_event();
 
     return 0;
 }
@@ -144,12 +248,7 @@ int large_packet_send_whole_mask_get(
         return -1;
     }
 
-    /* Use hard-coded value since it's coupled to the variable type. */
-    if (n_sub_packets == 64) {
-        *mask = UINT64_MAX;
-    } else {
-        *mask = (((uint64_t) 1) << n_sub_packets) - 1;
-    }
+    *mask = lprr_whole_mask(n_sub_packets);
 
     return 0;
 }
@@ -178,8 +277,11 @@ int large_packet_register_tx(
     }
 
     large_packet->payload = payload;
+    large_packet->read_sub_packet = NULL;
+    large_packet->read_ctx = NULL;
     large_packet->len = len;
     large_packet->id = packet_id;
+    large_packet->segment = 0;
 
     div_t d = div(len, LARGE_PACKET_SUBPACKET_MAX_BYTES);
     large_packet->num_sub_packets = d.quot + ((d.rem != 0) ? 1 : 0);
@@ -195,6 +297,47 @@ int large_packet_register_tx(
     return 0;
 }
 
+int large_packet_register_tx_source(
+    large_packet_t *large_packet,
+    const uint16_t packet_id,
+    const uint16_t len,
+    large_packet_read_fn_t read_sub_packet,
+    void *ctx)
+{
+    if (read_sub_packet == NULL || len == 0) {
+        return -1;
+    }
+    if (len > (LARGE_PACKET_SUBPACKET_MAX_BYTES
+               * LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS)
+    ) {
+        P_ERR("%s: ! packet too large\n", __func__);
+        return -1;
+    }
+
+    large_packet->payload = NULL;
+    large_packet->read_sub_packet = read_sub_packet;
+    large_packet->read_ctx = ctx;
+    large_packet->len = len;
+    large_packet->id = packet_id;
+    large_packet->segment = 0;
+    large_packet->num_sub_packets = large_packet_n_sub_packets_get(len);
+
+    P_DEBUG(
+        "Registered for transmission: packet %d, len %d, num_sub_packets %d, read on demand\n",
+        packet_id,
+        len,
+        large_packet->num_sub_packets);
+
+    return 0;
+}
+
+void large_packet_segment_set(
+    large_packet_t *large_packet,
+    const uint16_t segment)
+{
+    large_packet->segment = segment;
+}
+
 int large_packet_send(
     large_packet_t *large_packet)
 {
@@ -210,80 +353,355 @@ int large_packet_send(
     return 0;
 }
 
+int large_packet_push(
+    large_packet_t *large_packet,
+    const mira_net_address_t *dst)
+{
+    if (large_packet->num_sub_packets > LARGE_PACKET_PUSH_MAX_SUB_PACKETS) {
+        P_ERR("%s: too many sub-packets to push (%d > %d)\n",
+            __func__,
+            large_packet->num_sub_packets,
+            LARGE_PACKET_PUSH_MAX_SUB_PACKETS);
+        return -1;
+    }
+
+    return push_start(
+        large_packet,
+        dst,
+        LARGE_PACKET_PUSH_PERIOD_MS,
+        LPSIG_FLAG_PUSH);
+}
+
+int large_packet_push_subscribed(
+    large_packet_t *large_packet,
+    const mira_net_address_t *dst,
+    const uint16_t period_ms)
+{
+    return push_start(
+        large_packet,
+        dst,
+        period_ms,
+        LPSIG_FLAG_PUSH | LPSIG_FLAG_SUBSCRIBED);
+}
+
+int large_packet_announce(
+    large_packet_t *large_packet,
+    const mira_net_address_t *dst)
+{
+    return large_packet_announce_batch(&large_packet, 1, dst);
+}
+
+int large_packet_announce_batch(
+    large_packet_t *const *large_packets,
+    const uint8_t n_large_packets,
+    const mira_net_address_t *dst)
+{
+    if (n_large_packets == 0 || n_large_packets > LPSIG_BATCH_MAX_ENTRIES) {
+        P_ERR("%s: wrong number of large packets (%d)\n",
+            __func__,
+            n_large_packets);
+        return -1;
+    }
+
+    process_exit(&large_packet_announce_proc);
+    large_packet_announce_dst = *dst;
+    memcpy(
+        large_packet_announced,
+        large_packets,
+        n_large_packets * sizeof(large_packets[0]));
+    large_packet_n_announced = n_large_packets;
+    process_start(&large_packet_announce_proc, NULL);
+
+    return 0;
+}
+
+int large_packet_multicast(
+    large_packet_t *large_packet,
+    const mira_net_address_t *group)
+{
+    if (large_packet_currently_sending) {
+        P_DEBUG("Large packet multicast requested while not available\n");
+        return -1;
+    }
+
+    if (lpsig_send(
+        group,
+        large_packet->id,
+        large_packet->num_sub_packets,
+        LPSIG_FLAG_PUSH,
+        large_packet->segment) < 0
+    ) {
+        return -1;
+    }
+
+    large_packet->node_addr = *group;
+    large_packet->node_port = LARGE_PACKET_RX_UDP_PORT;
+    large_packet->period_ms = LARGE_PACKET_PUSH_PERIOD_MS;
+    /* Receivers know the large packet from the signal only */
+    large_packet->session = LPREQ_NO_SESSION;
+
+    if (large_packet_send_whole_mask_get(
+        &large_packet->mask,
+        large_packet->num_sub_packets) < 0
+    ) {
+        return -1;
+    }
+
+    process_exit(&large_packet_multicast_proc);
+    process_start(&large_packet_multicast_proc, large_packet);
+
+    return 0;
+}
+
+int large_packet_register_rx_sink(
+    large_packet_t *lp,
+    large_packet_write_fn_t write_sub_packet,
+    void *ctx)
+{
+    if (write_sub_packet == NULL) {
+        return -1;
+    }
+
+    lp->payload = NULL;
+    lp->write_sub_packet = write_sub_packet;
+    lp->write_ctx = ctx;
+
+    return 0;
+}
+
+int large_packet_receive_prepare(
+    large_packet_t *slots,
+    const uint8_t n_slots,
+    const mira_net_address_t *src,
+    const uint16_t src_port,
+    const uint16_t packet_id,
+    const uint8_t n_sub_packets,
+    const uint16_t segment,
+    const uint16_t period_ms,
+    large_packet_t **lp,
+    uint64_t *request_mask)
+{
+    uint64_t whole_mask;
+    large_packet_t *slot = NULL;
+    bool resume = false;
+
+    if (n_slots == 0) {
+        return -1;
+    }
+
+    if (large_packet_send_whole_mask_get(&whole_mask, n_sub_packets) < 0) {
+        P_ERR("%s: could not get mask for large packet\n", __func__);
+        return -1;
+    }
+
+    /* The slot of the same large packet from the same source, if its partial
+     * reception is still fresh. Else an empty slot, or the one last received
+     * into the longest ago. */
+    for (int i = 0; i < n_slots; ++i) {
+        large_packet_t *s = &slots[i];
+        uint64_t slot_whole_mask;
+        bool partial = s->mask != 0
+            && large_packet_send_whole_mask_get(
+                &slot_whole_mask,
+                s->num_sub_packets) == 0
+            && s->mask != slot_whole_mask
+            && (clock_time() - s->last_rx_time)
+            < LARGE_PACKET_RESUME_TIMEOUT_S * CLOCK_SECOND;
+
+        if (partial
+            && s->id == packet_id
+            && s->num_sub_packets == n_sub_packets
+            && s->segment == segment
+            && memcmp(&s->node_addr, src, sizeof(mira_net_address_t)) == 0
+        ) {
+            slot = s;
+            resume = true;
+            break;
+        }
+
+        if (slot == NULL
+            || (slot->mask != 0
+                && (s->mask == 0
+                    || (clock_time() - s->last_rx_time)
+                    > (clock_time() - slot->last_rx_time)))
+        ) {
+            slot = s;
+        }
+    }
+
+    /* The ongoing reception, if any, is unfinished, since the process ends
+     * once all sub-packets are received. Its partial state stays in its slot,
+     * unless that slot is taken over. */
+    if (process_is_running(&large_packet_receive_proc)) {
+        large_packet_t *ongoing = large_packet_rx_ongoing;
+
+        /* Compact sub-packets of its request are late now */
+        lpsp_session_close(ongoing->session);
+        ongoing->session = LPREQ_NO_SESSION;
+        if (ongoing != slot || !resume) {
+            /* Interrupted: stop its sender */
+            RUN_CHECK(lpreq_cancel_send(
+                &ongoing->node_addr,
+                ongoing->node_port,
+                ongoing->id));
+        }
+        process_exit(&large_packet_receive_proc);
+    }
+
+    if (resume) {
+        LPTR_DEBUG(LPTR_EV_RX_RESUME,
+            packet_id,
+            (uint32_t) (slot->mask & UINT32_MAX),
+            (uint32_t) (slot->mask >> 32));
+    } else {
+        *slot = (large_packet_t) {
+            .payload = slot->payload,
+            .write_sub_packet = slot->write_sub_packet,
+            .write_ctx = slot->write_ctx,
+            .len = 0,
+            .node_addr = *src,
+            .id = packet_id,
+            .segment = segment,
+            .mask = 0, /* bit at 1 means sub-packet received */
+            .num_sub_packets = n_sub_packets,
+            .session = LPREQ_NO_SESSION,
+        };
+    }
+
+    slot->node_port = src_port;
+    slot->period_ms = period_ms;
+    slot->last_rx_time = clock_time();
+    slot->session = lpsp_session_open(src, packet_id, n_sub_packets);
+
+    large_packet_rx_ongoing = slot;
+    *lp = slot;
+    *request_mask = whole_mask & ~slot->mask;
+
+    return resume ? 1 : 0;
+}
+
 PROCESS_THREAD(large_packet_receive_proc, ev, data)
 {
     PROCESS_BEGIN();
 
-    static struct etimer timeout_timer;
+    static lpt_timer_t timeout_timer;
     static large_packet_t *lp;
     static bool rx_done;
     static int re_tx_requests_left;
+    static int reports_countdown;
 
     lp = (large_packet_t *) data;
-    re_tx_requests_left = LP_MAX_NUM_RETRANSMISSION_REQUESTS;
+    /* Only sub-packets of this large packet, from its sender */
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_subpacket_received,
+        &lp->node_addr,
+        lp->id));
+    re_tx_requests_left = LPRR_MAX_RETRANSMISSION_REQUESTS;
+    reports_countdown = LPRR_PROGRESS_REPORT_INTERVAL;
 
     rx_done = false;
 
     while (!rx_done) {
-        uint32_t timeout_ticks = 10 * lp->period_ms * CLOCK_SECOND / 1000;
-        etimer_set(&timeout_timer, timeout_ticks);
+        uint32_t timeout_ms = lprr_timeout_ms(
+            lp->period_ms,
+            mira_random_generate());
+        lpt_set(&timeout_timer, timeout_ms * CLOCK_SECOND / 1000);
 
         PROCESS_WAIT_EVENT_UNTIL(
-            etimer_expired(&timeout_timer)
+            lpt_expired(&timeout_timer)
             || ev == event_lp_subpacket_received);
 
-        if (etimer_expired(&timeout_timer)) {
-            P_DEBUG("%s: timed out while receiving sub-packets\n", __func__);
+        if (lpt_expired(&timeout_timer)) {
+            LPTR_DEBUG(LPTR_EV_RX_TIMEOUT, lp->id, re_tx_requests_left, 0);
             if (re_tx_requests_left > 0) {
                 request_for_missing_subpackets(lp);
                 re_tx_requests_left--;
             } else {
-                P_DEBUG(
-                    "%s: max number of re-transmission requests reached (%d). Abort.\n",
-                    __func__,
-                    LP_MAX_NUM_RETRANSMISSION_REQUESTS);
+                LPTR_DEBUG(LPTR_EV_RX_ABORT, lp->id, 0, 0);
+                RUN_CHECK(lpreq_cancel_send(
+                    &lp->node_addr,
+                    lp->node_port,
+                    lp->id));
+                lpd_unsubscribe(PROCESS_CURRENT(), event_lp_subpacket_received);
+                lpsp_session_close(lp->session);
+                lp->session = LPREQ_NO_SESSION;
                 PROCESS_EXIT();
             }
         } else if (ev == event_lp_subpacket_received) {
             lp_event_subpacket_data_t *ed = (lp_event_subpacket_data_t *) data;
 
             if (lp_fault_injected()) {
-                P_DEBUG("%s: simulate packet loss by discarding sub-packet %d\n",
-                    __func__,
-                    ed->sub_packet_index);
+                LPTR_DEBUG(LPTR_EV_SUBPACKET_DROP, lp->id, ed->sub_packet_index, 0);
                 continue;
             }
 
-            if (ed->packet_id != lp->id) {
-                P_DEBUG("%s: received sub-packet with id %d, expected %d\n",
-                    __func__,
-                    ed->packet_id,
-                    lp->id);
-                PROCESS_EXIT();
+            /* Packet id and source are checked by the subscription filter,
+             * the number of sub-packets and the index are not */
+            if (!lprr_sub_packet_valid(
+                lp->num_sub_packets,
+                ed->n_sub_packets,
+                ed->sub_packet_index,
+                ed->payload_len)
+            ) {
+                LPTR_DEBUG(LPTR_EV_SUBPACKET_DROP, lp->id, ed->sub_packet_index, 0);
+                continue;
             }
 
-            /* Add checking of address and port here, especially if
-             * implementing multiple parallel transactions.  */
-
-            uint16_t offset_in_dst_payload = ed->sub_packet_index
+            /* Within the payload buffer, which holds one segment */
+            uint32_t offset_in_dst_payload = (uint32_t) ed->sub_packet_index
                 * LARGE_PACKET_SUBPACKET_MAX_BYTES;
 
-            memcpy(lp->payload + offset_in_dst_payload, ed->payload,
-                ed->payload_len);
+            lp->last_rx_time = clock_time();
+
+            if (lp->mask & (((uint64_t) 1) << ed->sub_packet_index)) {
+                /* Duplicate, possibly from before a resume */
+                continue;
+            }
+
+            LPPROF_START(LPPROF_REASSEMBLY_COPY);
+            if (lp->payload != NULL) {
+                memcpy(lp->payload + offset_in_dst_payload, ed->payload,
+                    ed->payload_len);
+            } else if (lp->write_sub_packet(
+                lp->write_ctx,
+                (uint32_t) lp->segment * LARGE_PACKET_SEGMENT_MAX_BYTES
+                + offset_in_dst_payload,
+                ed->payload,
+                ed->payload_len) < 0
+            ) {
+                /* Left out of the mask, to be requested again */
+                P_ERR("%s: could not write sub-packet %d\n",
+                    __func__,
+                    ed->sub_packet_index);
+                continue;
+            }
+            LPPROF_STOP(LPPROF_REASSEMBLY_COPY);
             lp->len += ed->payload_len;
 
             lp->mask |= ((uint64_t) 1) << ed->sub_packet_index;
 
-            uint64_t all_done_mask = (ed->n_sub_packets == 64)
-                ? UINT64_MAX
-                : (((uint64_t) 1) << ed->n_sub_packets) - 1;
-            rx_done = lp->mask == all_done_mask;
+            rx_done = lp->mask == lprr_whole_mask(lp->num_sub_packets);
+
+            if (--reports_countdown == 0 || rx_done) {
+                reports_countdown = LPRR_PROGRESS_REPORT_INTERVAL;
+                RUN_CHECK(lpack_send(
+                    &lp->node_addr,
+                    lp->node_port,
+                    lp->id,
+                    lp->mask));
+            }
         }
     }
 
-    if (process_post(PROCESS_BROADCAST, event_lp_received, NULL)
-        != PROCESS_ERR_OK) {
-        P_ERR("%s: process_post event_lp_received\n", __func__);
+    lpd_unsubscribe(PROCESS_CURRENT(), event_lp_subpacket_received);
+    lpsp_session_close(lp->session);
+    lp->session = LPREQ_NO_SESSION;
+
+    LPTR_DEBUG(LPTR_EV_RX_DONE, lp->id, lp->len, 0);
+
+    if (lpd_post(event_lp_received, lp, &lp->node_addr, lp->id) == 0) {
+        P_DEBUG("%s: no process subscribed to event_lp_received\n", __func__);
     }
 
     PROCESS_END();
@@ -295,38 +713,472 @@ PROCESS_THREAD(large_packet_receive_proc, ev, data)
 
 PROCESS_THREAD(large_packet_send_proc, ev, data)
 {
-    static struct etimer timer;
+    static lpt_timer_t timer;
     static int sub_packet_send_status;
     static large_packet_t *large_packet;
+    static uint64_t acked_mask;
+    static uint64_t whole_mask;
+    static bool cancelled;
+    static lp_event_sent_data_t sent_event_data;
+    static clock_time_t queued_since;
+    static clock_time_t budget_delay;
+    static pacing_t pacing;
+    static bool pushed;
 
     PROCESS_BEGIN();
 
     large_packet = (large_packet_t *) data;
+    pushed = large_packet_push_started;
+    large_packet_push_started = false;
+
+    /* Feedback from the receiver of this large packet only */
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_acked,
+        &large_packet->node_addr,
+        large_packet->id));
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_cancelled,
+        &large_packet->node_addr,
+        large_packet->id));
 
     large_packet_currently_sending = true;
     sub_packet_send_status = 0; /* >= 0 means OK */
+    pacing = (pacing_t) { .period_ms = large_packet->period_ms };
+    acked_mask = 0;
+    cancelled = false;
+    (void) large_packet_send_whole_mask_get(
+        &whole_mask,
+        large_packet->num_sub_packets);
+
+    LPTR_DEBUG(LPTR_EV_TX_START,
+        large_packet->id,
+        (uint32_t) (large_packet->mask & UINT32_MAX),
+        (uint32_t) (large_packet->mask >> 32));
 
-    P_DEBUG(
-        "Start of large packet transmission (@%d ms), mask 0x%08lx%08lx\n",
-        large_packet->period_ms,
-        (uint32_t) (large_packet->mask >> 32),
-        (uint32_t) (large_packet->mask & (UINT32_MAX))
-    );
+    while (large_packet->mask != 0
+           && sub_packet_send_status >= 0
+           && acked_mask != whole_mask
+    ) {
+        /* Wait for the node-wide airtime budget, see lp_budget.h */
+        queued_since = clock_time();
+        while ((budget_delay = lpb_delay(
+            lpsp_datagram_size(LARGE_PACKET_SUBPACKET_MAX_BYTES))) > 0
+        ) {
+            lpt_set(&timer, budget_delay);
+            do {
+                PROCESS_WAIT_EVENT_UNTIL(
+                    lpt_expired(&timer)
+                    || ev == event_lp_acked
+                    || ev == event_lp_cancelled);
+                send_feedback_handle(large_packet, &acked_mask, &cancelled, ev, data);
+            } while (!lpt_expired(&timer)
+                     && acked_mask != whole_mask
+                     && !cancelled);
+            if (acked_mask == whole_mask || cancelled) {
+                break;
+            }
+        }
+        lpb_delay_record(clock_time() - queued_since);
+        if (acked_mask == whole_mask || cancelled) {
+            break;
+        }
 
-    while (large_packet->mask != 0 && sub_packet_send_status >= 0) {
+        LPPROF_START(LPPROF_SUBPACKET_SEND);
         sub_packet_send_status = next_sub_packet_send(large_packet);
-        etimer_set(&timer, large_packet->period_ms * CLOCK_SECOND / 1000);
-        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+        LPPROF_STOP(LPPROF_SUBPACKET_SEND);
+        sub_packet_send_status =
+            pacing_update(large_packet, &pacing, sub_packet_send_status);
+        lpt_set(&timer, pacing.period_ms * CLOCK_SECOND / 1000);
+        do {
+            PROCESS_WAIT_EVENT_UNTIL(
+                lpt_expired(&timer)
+                || ev == event_lp_acked
+                || ev == event_lp_cancelled);
+            send_feedback_handle(large_packet, &acked_mask, &cancelled, ev, data);
+        } while (!lpt_expired(&timer)
+                 && acked_mask != whole_mask
+                 && !cancelled);
     }
 
     P_DEBUG("Large packet sent: %s\n",
         (sub_packet_send_status >= 0) ? "OK" : "Failed");
 
+    /* A new request for missing sub-packets may restart the transmission while
+     * waiting for completion. */
     large_packet_currently_sending = false;
 
+    /* Tail of the transfer: a large packet pipelined behind it is signaled now */
+    process_poll(&large_packet_announce_proc);
+
+    if (sub_packet_send_status >= 0 && acked_mask != whole_mask && !cancelled) {
+        lpt_set(
+            &timer,
+            LP_COMPLETION_ACK_WAIT_PERIODS * large_packet->period_ms
+            * CLOCK_SECOND / 1000);
+        do {
+            PROCESS_WAIT_EVENT_UNTIL(
+                lpt_expired(&timer)
+                || ev == event_lp_acked
+                || ev == event_lp_cancelled);
+            send_feedback_handle(large_packet, &acked_mask, &cancelled, ev, data);
+        } while (!lpt_expired(&timer)
+                 && acked_mask != whole_mask
+                 && !cancelled);
+    }
+
+    LPTR_DEBUG(LPTR_EV_TX_END, large_packet->id, acked_mask == whole_mask, 0);
+
+    sent_event_data = (lp_event_sent_data_t) {
+        .packet_id = large_packet->id,
+        .completed = acked_mask == whole_mask,
+    };
+    lpd_unsubscribe(PROCESS_CURRENT(), event_lp_acked);
+    lpd_unsubscribe(PROCESS_CURRENT(), event_lp_cancelled);
+
+    if (pushed
+        && sub_packet_send_status >= 0
+        && acked_mask == 0
+        && !cancelled
+        && !process_is_running(&large_packet_announce_proc)
+    ) {
+        /* Not a single acknowledgement: the signal of the push is likely lost,
+         * and the receiver dropped the sub-packets without a reception for
+         * them. Announce instead, event_lp_sent comes with the outcome. */
+        P_DEBUG("Large packet %d: push not acknowledged, announcing\n",
+            large_packet->id);
+        large_packet_announce(large_packet, &large_packet->node_addr);
+        PROCESS_EXIT();
+    }
+
+    (void) lpd_post(
+        event_lp_sent,
+        &sent_event_data,
+        &large_packet->node_addr,
+        large_packet->id);
+
     PROCESS_END();
 }
 
+PROCESS_THREAD(large_packet_multicast_proc, ev, data)
+{
+    static lpt_timer_t timer;
+    static int sub_packet_send_status;
+    static large_packet_t *large_packet;
+    static uint64_t nack_mask;
+    static int repair_rounds_left;
+    static clock_time_t queued_since;
+    static clock_time_t budget_delay;
+    static pacing_t pacing;
+
+    PROCESS_BEGIN();
+
+    large_packet = (large_packet_t *) data;
+
+    /* Reports of missing sub-packets, from any receiver */
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_requested,
+        NULL,
+        large_packet->id));
+
+    large_packet_currently_sending = true;
+    sub_packet_send_status = 0; /* >= 0 means OK */
+    pacing = (pacing_t) { .period_ms = large_packet->period_ms };
+    repair_rounds_left = LP_MULTICAST_MAX_REPAIR_ROUNDS;
+
+    while (large_packet->mask != 0 && sub_packet_send_status >= 0) {
+        LPTR_DEBUG(LPTR_EV_MCAST_ROUND,
+            large_packet->id,
+            (uint32_t) (large_packet->mask & UINT32_MAX),
+            (uint32_t) (large_packet->mask >> 32));
+
+        nack_mask = 0;
+
+        while (large_packet->mask != 0 && sub_packet_send_status >= 0) {
+            /* Wait for the node-wide airtime budget, see lp_budget.h */
+            queued_since = clock_time();
+            while ((budget_delay = lpb_delay(
+                lpsp_datagram_size(LARGE_PACKET_SUBPACKET_MAX_BYTES))) > 0
+            ) {
+                lpt_set(&timer, budget_delay);
+                do {
+                    PROCESS_WAIT_EVENT_UNTIL(
+                        lpt_expired(&timer)
+                        || ev == event_lp_requested);
+                    multicast_nack_merge(large_packet, &nack_mask, ev, data);
+                } while (!lpt_expired(&timer));
+            }
+            lpb_delay_record(clock_time() - queued_since);
+
+            LPPROF_START(LPPROF_SUBPACKET_SEND);
+            sub_packet_send_status = next_sub_packet_send(large_packet);
+            LPPROF_STOP(LPPROF_SUBPACKET_SEND);
+            sub_packet_send_status =
+                pacing_update(large_packet, &pacing, sub_packet_send_status);
+            lpt_set(&timer, pacing.period_ms * CLOCK_SECOND / 1000);
+            /* Early reports are merged into the next round as well */
+            do {
+                PROCESS_WAIT_EVENT_UNTIL(
+                    lpt_expired(&timer)
+                    || ev == event_lp_requested);
+                multicast_nack_merge(large_packet, &nack_mask, ev, data);
+            } while (!lpt_expired(&timer));
+        }
+
+        /* Collect reports of missing sub-packets from all receivers. The next
+         * round sends each sub-packet missed by any receiver once. */
+        lpt_set(
+            &timer,
+            LP_MULTICAST_NACK_WINDOW_PERIODS * large_packet->period_ms
+            * CLOCK_SECOND / 1000);
+        do {
+            PROCESS_WAIT_EVENT_UNTIL(
+                lpt_expired(&timer)
+                || ev == event_lp_requested);
+            multicast_nack_merge(large_packet, &nack_mask, ev, data);
+        } while (!lpt_expired(&timer));
+
+        if (nack_mask != 0 && repair_rounds_left > 0) {
+            large_packet->mask = nack_mask;
+            if (large_packet->num_sub_packets < 64) {
+                large_packet->mask &=
+                    (((uint64_t) 1) << large_packet->num_sub_packets) - 1;
+            }
+            repair_rounds_left--;
+        } else if (nack_mask != 0) {
+            P_DEBUG("%s: max number of repair rounds reached (%d). Abort.\n",
+                __func__,
+                LP_MULTICAST_MAX_REPAIR_ROUNDS);
+        }
+    }
+
+    P_DEBUG("Large packet multicast: %s\n",
+        (sub_packet_send_status >= 0) ? "OK" : "Failed");
+
+    lpd_unsubscribe(PROCESS_CURRENT(), event_lp_requested);
+
+    large_packet_currently_sending = false;
+
+    PROCESS_END();
+}
+
+/* The request for a large packet acknowledges its signal. Requests may come
+ * from another address of the receiver than the one signaled, so they are only
+ * filtered on packet id. The large packets without reply yet are signaled
+ * again together. */
+PROCESS_THREAD(large_packet_announce_proc, ev, data)
+{
+    static lpt_timer_t timer;
+    static uint32_t retry_ms;
+    static uint8_t n_tries;
+    static bool replied[LPSIG_BATCH_MAX_ENTRIES];
+    static uint8_t n_replied;
+    static lp_event_sent_data_t sent_event_data[LPSIG_BATCH_MAX_ENTRIES];
+
+    PROCESS_BEGIN();
+
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_requested,
+        NULL,
+        LPD_ANY_PACKET_ID));
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_acked,
+        NULL,
+        LPD_ANY_PACKET_ID));
+
+    memset(replied, 0, sizeof(replied));
+    n_replied = 0;
+    retry_ms = LARGE_PACKET_ANNOUNCE_RETRY_MS;
+
+    if (process_is_running(&large_packet_send_proc)) {
+        /* Pipelined behind an ongoing transfer: signal at its tail, once its
+         * sub-packets are sent, so that the receiver can request these large
+         * packets as soon as it completes the ongoing one. */
+        PROCESS_WAIT_UNTIL(!large_packet_currently_sending);
+        lpt_set(&timer, 0);
+    } else {
+        lpt_set(
+            &timer,
+            mira_random_generate() % (LARGE_PACKET_ANNOUNCE_JITTER_MS + 1)
+            * CLOCK_SECOND / 1000);
+    }
+
+    n_tries = 0;
+    while (n_tries < LARGE_PACKET_ANNOUNCE_MAX_TRIES
+           && n_replied < large_packet_n_announced) {
+        PROCESS_WAIT_EVENT_UNTIL(
+            lpt_expired(&timer)
+            || ev == event_lp_requested
+            || ev == event_lp_acked);
+        announce_reply_handle(replied, &n_replied, ev, data);
+        if (!lpt_expired(&timer) || n_replied == large_packet_n_announced) {
+            continue;
+        }
+
+        announce_signal_send(replied);
+        n_tries++;
+
+        /* Randomized in [retry_ms, 2 * retry_ms] */
+        lpt_set(
+            &timer,
+            (retry_ms + mira_random_generate() % (retry_ms + 1))
+            * CLOCK_SECOND / 1000);
+        retry_ms = min(2 * retry_ms, LARGE_PACKET_ANNOUNCE_RETRY_MAX_MS);
+    }
+
+    /* Last chance for replies to the last signal */
+    while (n_replied < large_packet_n_announced && !lpt_expired(&timer)) {
+        PROCESS_WAIT_EVENT_UNTIL(
+            lpt_expired(&timer)
+            || ev == event_lp_requested
+            || ev == event_lp_acked);
+        announce_reply_handle(replied, &n_replied, ev, data);
+    }
+    lpt_stop(&timer);
+
+    lpd_unsubscribe(PROCESS_CURRENT(), event_lp_requested);
+    lpd_unsubscribe(PROCESS_CURRENT(), event_lp_acked);
+
+    for (int i = 0; i < large_packet_n_announced; ++i) {
+        LPTR_DEBUG(LPTR_EV_ANNOUNCE_END,
+            large_packet_announced[i]->id,
+            n_tries,
+            replied[i]);
+
+        if (replied[i]) {
+            continue;
+        }
+        P_DEBUG("Large packet %d: no reply to signal\n",
+            large_packet_announced[i]->id);
+        sent_event_data[i] = (lp_event_sent_data_t) {
+            .packet_id = large_packet_announced[i]->id,
+            .completed = false,
+        };
+        (void) lpd_post(
+            event_lp_sent,
+            &sent_event_data[i],
+            &large_packet_announce_dst,
+            large_packet_announced[i]->id);
+    }
+
+    PROCESS_END();
+}
+
+/* Mark the announced large packet a request or an acknowledgement replies
+ * to. Other events are ignored. */
+static void announce_reply_handle(
+    bool *replied,
+    uint8_t *n_replied,
+    process_event_t ev,
+    process_data_t data)
+{
+    uint16_t packet_id;
+
+    if (ev == event_lp_requested) {
+        packet_id = ((lp_event_requested_data_t *) data)->packet_id;
+    } else if (ev == event_lp_acked) {
+        packet_id = ((lp_event_acked_data_t *) data)->packet_id;
+    } else {
+        return;
+    }
+
+    for (int i = 0; i < large_packet_n_announced; ++i) {
+        if (!replied[i] && large_packet_announced[i]->id == packet_id) {
+            replied[i] = true;
+            (*n_replied)++;
+        }
+    }
+}
+
+/* Signal the announced large packets without reply, in a batch signal if
+ * several */
+static void announce_signal_send(
+    const bool *replied)
+{
+    lpsig_msg_t entries[LPSIG_BATCH_MAX_ENTRIES];
+    uint8_t n_entries = 0;
+    int ret;
+
+    for (int i = 0; i < large_packet_n_announced; ++i) {
+        if (!replied[i]) {
+            entries[n_entries++] = (lpsig_msg_t) {
+                .packet_id = large_packet_announced[i]->id,
+                .n_sub_packets = large_packet_announced[i]->num_sub_packets,
+                .flags = 0,
+                .segment = large_packet_announced[i]->segment,
+            };
+        }
+    }
+
+    if (n_entries == 1) {
+        ret = lpsig_send(
+            &large_packet_announce_dst,
+            entries[0].packet_id,
+            entries[0].n_sub_packets,
+            entries[0].flags,
+            entries[0].segment);
+    } else {
+        ret = lpsig_batch_send(&large_packet_announce_dst, entries, n_entries);
+    }
+    if (ret < 0) {
+        P_ERR("%s: could not signal %d large packets\n", __func__, n_entries);
+    }
+}
+
+/* Merge the progress reported by the receiver, and skip the sub-packets it
+ * already has. Stop sending if the receiver cancels. */
+static void send_feedback_handle(
+    large_packet_t *lp,
+    uint64_t *acked_mask,
+    bool *cancelled,
+    process_event_t ev,
+    process_data_t data)
+{
+    if (ev == event_lp_acked) {
+        const lp_event_acked_data_t *ad = (lp_event_acked_data_t *) data;
+        if (ad->packet_id != lp->id
+            || memcmp(&ad->src, &lp->node_addr, sizeof(mira_net_address_t)) != 0
+        ) {
+            return;
+        }
+
+        *acked_mask |= ad->mask;
+        lp->mask &= ~ad->mask;
+    } else if (ev == event_lp_cancelled) {
+        const lp_event_cancelled_data_t *cd = (lp_event_cancelled_data_t *) data;
+        if (cd->packet_id != lp->id
+            || memcmp(&cd->src, &lp->node_addr, sizeof(mira_net_address_t)) != 0
+        ) {
+            return;
+        }
+
+        P_DEBUG("Large packet %d cancelled by receiver\n", lp->id);
+        *cancelled = true;
+        lp->mask = 0;
+    }
+}
+
+/* Merge the missing sub-packets reported by a multicast receiver */
+static void multicast_nack_merge(
+    const large_packet_t *lp,
+    uint64_t *nack_mask,
+    process_event_t ev,
+    process_data_t data)
+{
+    if (ev != event_lp_requested) {
+        return;
+    }
+
+    const lp_event_requested_data_t *rd = (lp_event_requested_data_t *) data;
+    if (rd->packet_id == lp->id) {
+        *nack_mask |= rd->mask;
+    }
+}
+
 static void request_for_missing_subpackets(
     const large_packet_t *lp)
 {
@@ -343,7 +1195,8 @@ static void request_for_missing_subpackets(
         lp->node_port,
         lp->id,
         new_request_mask,
-        lp->period_ms));
+        lp->period_ms,
+        lp->session));
 }
 
 static int next_sub_packet_send(
@@ -356,6 +1209,11 @@ static int next_sub_packet_send(
 
     sub_packet_t sub_packet = pick_next_to_send(large_packet);
 
+    if (sub_packet.len == 0) {
+        P_ERR("%s: no sub-packet to send in mask\n", __func__);
+        return -1;
+    }
+
     if (sub_packet.len > LARGE_PACKET_SUBPACKET_MAX_BYTES) {
         P_ERR("%s: sub-packet too large! (%d > %d)\n",
             __func__,
@@ -364,10 +1222,27 @@ static int next_sub_packet_send(
         return -1;
     }
 
+    if (large_packet->payload == NULL) {
+        /* Only one sub-packet in RAM at a time */
+        static uint8_t sub_packet_buffer[LARGE_PACKET_SUBPACKET_MAX_BYTES];
+
+        if (large_packet->read_sub_packet(
+            large_packet->read_ctx,
+            sub_packet.index,
+            sub_packet_buffer,
+            sub_packet.len) < 0
+        ) {
+            P_ERR("%s: could not read sub-packet %d\n", __func__, sub_packet.index);
+            return -1;
+        }
+        sub_packet.payload = sub_packet_buffer;
+    }
+
     int ret = lpsp_send(
         &large_packet->node_addr,
         large_packet->node_port,
         large_packet->id,
+        large_packet->session,
         sub_packet.index,
         large_packet->num_sub_packets,
         sub_packet.payload,
@@ -376,29 +1251,113 @@ static int next_sub_packet_send(
 
     if (ret >= 0) {
         large_packet->mask &= ~(((uint64_t) 1) << sub_packet.index);
-    } else {
+    } else if (ret != LPSP_ERROR_QUEUE_FULL) {
         P_ERR("%s: could not send sub-packet\n", __func__);
     }
 
     return ret;
 }
 
+/* Signal the large packet with flags, and send all its sub-packets right
+ * after, at period_ms. */
+static int push_start(
+    large_packet_t *large_packet,
+    const mira_net_address_t *dst,
+    uint16_t period_ms,
+    uint8_t flags)
+{
+    if (large_packet_currently_sending) {
+        P_DEBUG("Large packet push requested while not available\n");
+        return -1;
+    }
+
+    if (lpsig_send(
+        dst,
+        large_packet->id,
+        large_packet->num_sub_packets,
+        flags,
+        large_packet->segment) < 0
+    ) {
+        return -1;
+    }
+
+    /* Sub-packets go to the same port as the signal */
+    large_packet->node_addr = *dst;
+    large_packet->node_port = LARGE_PACKET_RX_UDP_PORT;
+    large_packet->period_ms = period_ms;
+    large_packet->session = LPREQ_NO_SESSION;
+
+    if (large_packet_send_whole_mask_get(
+        &large_packet->mask,
+        large_packet->num_sub_packets) < 0
+    ) {
+        return -1;
+    }
+
+    large_packet_push_started = true;
+    if (large_packet_send(large_packet) < 0) {
+        large_packet_push_started = false;
+        return -1;
+    }
+    return 0;
+}
+
+/* A full TX queue is not an error: the sub-packet stays in the mask to be sent
+ * again, and the pacing period grows to let the queue drain. It shrinks back
+ * to the requested period as transmissions succeed. Returns the status to
+ * continue the transfer with. */
+static int pacing_update(
+    const large_packet_t *lp,
+    pacing_t *pacing,
+    int status)
+{
+    if (status == LPSP_ERROR_QUEUE_FULL) {
+        if (++pacing->n_queue_full > LP_QUEUE_FULL_MAX_RETRIES) {
+            P_ERR("%s: TX queue full, giving up\n", __func__);
+            return -1;
+        }
+        uint32_t max_period_ms = (uint32_t) lp->period_ms * LP_PACING_MAX_FACTOR;
+        if (max_period_ms < LP_PACING_MIN_BACKOFF_MS) {
+            max_period_ms = LP_PACING_MIN_BACKOFF_MS;
+        }
+        pacing->period_ms = pacing->period_ms ? 2 * pacing->period_ms
+            : LP_PACING_MIN_BACKOFF_MS;
+        if (pacing->period_ms > max_period_ms) {
+            pacing->period_ms = max_period_ms;
+        }
+        return 0;
+    }
+
+    if (status >= 0) {
+        pacing->n_queue_full = 0;
+        pacing->period_ms -= pacing->period_ms / 8;
+        if (pacing->period_ms < lp->period_ms) {
+            pacing->period_ms = lp->period_ms;
+        }
+    }
+    return status;
+}
+
 static sub_packet_t pick_next_to_send(
     const large_packet_t *lp)
 {
+    /* len 0 means none found. payload remains NULL if read on demand. */
     sub_packet_t sp = {
+        .len = 0,
         .payload = NULL,
     };
 
     for (int i = 0;
-         sp.payload == NULL
+         sp.len == 0
          && i < LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS
          && i < lp->num_sub_packets;
          ++i
     ) {
         if ((((uint64_t) 1) << i) & lp->mask) {
             sp.index = i;
-            sp.payload = lp->payload + i * LARGE_PACKET_SUBPACKET_MAX_BYTES;
+            if (lp->payload != NULL) {
+                sp.payload = lp->payload + i * LARGE_PACKET_SUBPACKET_MAX_BYTES;
+            }
 
             if (i == (lp->num_sub_packets - 1)) {
                 /* last sub-packet might be smaller than max */
@@ -424,12 +1383,12 @@ static void large_packet_udp_listen_callback(
     const mira_net_udp_callback_metadata_t *metadata,
     void *storage)
 {
-    char buffer[MIRA_NET_MAX_ADDRESS_STR_LEN];
+    LPPROF_START(LPPROF_UDP_CALLBACK);
 
-    P_DEBUG("Received UDP packet from [%s]:%u, len %d\n",
-        mira_net_toolkit_format_address(buffer, metadata->source_address),
+    LPTR_DEBUG(LPTR_EV_UDP_RX,
         metadata->source_port,
-        data_len);
+        data_len,
+        LPTR_ADDRESS_TAIL(metadata->source_address));
 
     if (data_len < LP_HEADER_SIZE) {
         P_ERR("%s: UDP packet too short\n", __func__);
@@ -439,6 +1398,10 @@ static void large_packet_udp_listen_callback(
     lpsig_handle_data(data, data_len, metadata);
     lpreq_handle_data(data, data_len, metadata);
     lpsp_handle_data(data, data_len, metadata);
+    lpack_handle_data(data, data_len, metadata);
+    lpsub_handle_data(data, data_len, metadata);
+
+    LPPROF_STOP(LPPROF_UDP_CALLBACK);
 }
 
 static bool lp_fault_injected(
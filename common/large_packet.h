@@ -11,20 +11,41 @@ form without prior written permission from LumenRadio AB.
 #include <stdbool.h>
 #include <stdint.h>
 
-/* Open port receiver for signals */
-#define LARGE_PACKET_RX_UDP_PORT   (1520)
-
-/* Size of single frames to split the large packet into.  This size may be
- * larger than max payload for a single radio packet, in which case Mira
- * (6LoWPAN) divides the sub-packet into fragments. This has the advantage of
- * reducing overhead, at the cost of possible increase of number
- * re-transmissions. */
-#define LARGE_PACKET_SUBPACKET_MAX_BYTES     (330)
+/* Protocol constants: LARGE_PACKET_RX_UDP_PORT, LARGE_PACKET_SUBPACKET_MAX_BYTES,
+ * LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS, LARGE_PACKET_PUSH_PERIOD_MS */
+#include "lp_wire.h"
+
+/* Large packets of at most this number of sub-packets may be pushed: the
+ * sub-packets follow the signal directly, without waiting for a request. Larger
+ * packets use the signal, request, data sequence. */
+#define LARGE_PACKET_PUSH_MAX_SUB_PACKETS  (2)
+
+/* Announcement of a large packet with large_packet_announce(): the first signal
+ * is delayed by a random time of up to LARGE_PACKET_ANNOUNCE_JITTER_MS, so that
+ * nodes on the same schedule do not signal at the same moment. Without reply,
+ * the signal is sent again after a random time between one and two times the
+ * retry interval, which starts at LARGE_PACKET_ANNOUNCE_RETRY_MS and doubles up
+ * to LARGE_PACKET_ANNOUNCE_RETRY_MAX_MS. The announcement is given up after
+ * LARGE_PACKET_ANNOUNCE_MAX_TRIES signals. */
+#ifndef LARGE_PACKET_ANNOUNCE_JITTER_MS
+#define LARGE_PACKET_ANNOUNCE_JITTER_MS  (2000)
+#endif
+#ifndef LARGE_PACKET_ANNOUNCE_RETRY_MS
+#define LARGE_PACKET_ANNOUNCE_RETRY_MS  (500)
+#endif
+#ifndef LARGE_PACKET_ANNOUNCE_RETRY_MAX_MS
+#define LARGE_PACKET_ANNOUNCE_RETRY_MAX_MS  (8000)
+#endif
+#ifndef LARGE_PACKET_ANNOUNCE_MAX_TRIES
+#define LARGE_PACKET_ANNOUNCE_MAX_TRIES  (6)
+#endif
 
-/* Max number of messages into which a large packet may be split */
-/* The bit mask sent in requests must be large enough to accommodate for this
- * number of sub-packets. */
-#define LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS  (64)
+/* Time during which a partially received large packet is kept in its slot, so
+ * that its reception can resume from the already received sub-packets. See
+ * large_packet_receive_prepare(). */
+#ifndef LARGE_PACKET_RESUME_TIMEOUT_S
+#define LARGE_PACKET_RESUME_TIMEOUT_S  (10 * 60)
+#endif
 
 /* Byte size of headers, which determines the type of message. */
 #define LP_HEADER_SIZE (2)
@@ -35,17 +56,48 @@ typedef enum {
     LARGE_PACKET_SENDER,
 } large_packet_role_t;
 
+/* Read sub-packet sub_packet_index of a large packet into buffer, len bytes.
+ * ctx is the pointer given at registration. Return negative on error. */
+typedef int (*large_packet_read_fn_t)(
+    void *ctx,
+    uint8_t sub_packet_index,
+    uint8_t *buffer,
+    uint16_t len);
+
+/* Write a received sub-packet, len bytes, at byte offset offset of a backing
+ * store: segment * LARGE_PACKET_SEGMENT_MAX_BYTES
+ * + sub_packet_index * LARGE_PACKET_SUBPACKET_MAX_BYTES. ctx is the pointer
+ * given at registration. Return negative on error, and the sub-packet is
+ * requested again. */
+typedef int (*large_packet_write_fn_t)(
+    void *ctx,
+    uint32_t offset,
+    const uint8_t *data,
+    uint16_t len);
+
 /* Type used both on the receiving and the sending nodes */
 typedef struct {
     uint8_t *payload;
+    /* Sending side, if payload is NULL: sub-packets are read on demand */
+    large_packet_read_fn_t read_sub_packet;
+    void *read_ctx;
+    /* Receiving side, if payload is NULL: sub-packets are written to a sink */
+    large_packet_write_fn_t write_sub_packet;
+    void *write_ctx;
     uint16_t len;
     /* Address and port to the other node participating in the communication */
     mira_net_address_t node_addr;
     uint16_t node_port;
     uint16_t id;
+    /* Segment of a larger object, see LARGE_PACKET_SEGMENT_MAX_BYTES */
+    uint16_t segment;
     uint16_t period_ms;
     uint64_t mask; /* bit 1 for sub-packets to send, or received */
     uint8_t num_sub_packets;
+    /* Handle for compact sub-packets, from the request, or LPREQ_NO_SESSION */
+    uint8_t session;
+    /* Time of last received sub-packet, receiving side only */
+    clock_time_t last_rx_time;
 } large_packet_t;
 
 int large_packet_init(
@@ -68,10 +120,87 @@ int large_packet_register_tx(
     uint8_t *payload,
     const uint16_t len);
 
-/* Send the registered large packet. */
+/* Register data to send, read on demand from read_sub_packet, one sub-packet
+ * at a time, including for re-transmissions. The large packet is never held
+ * whole in RAM. Transmission occurs only when requested by a receiver. */
+int large_packet_register_tx_source(
+    large_packet_t *large_packet,
+    const uint16_t packet_id,
+    const uint16_t len,
+    large_packet_read_fn_t read_sub_packet,
+    void *ctx);
+
+/* Send the registered large packet as segment segment of a larger object, i.e.
+ * at byte offset segment * LARGE_PACKET_SEGMENT_MAX_BYTES of the receiver's
+ * sink. All segments of an object but the last one must be whole. Call after
+ * registration, which resets the segment to 0. */
+void large_packet_segment_set(
+    large_packet_t *large_packet,
+    const uint16_t segment);
+
+/* Send the registered large packet. Event event_lp_sent is posted once the
+ * receiver acknowledges the whole large packet, or gives up. The payload is no
+ * longer needed after that. */
 int large_packet_send(
     large_packet_t *large_packet);
 
+/* Signal the registered large packet to dst, and send all its sub-packets
+ * right after, without waiting for a request. The receiver requests missing
+ * sub-packets, if any. Only for large packets of at most
+ * LARGE_PACKET_PUSH_MAX_SUB_PACKETS sub-packets.
+ *
+ * If the receiver acknowledges none of the sub-packets, e.g. as the signal is
+ * lost, the large packet is announced instead (see large_packet_announce()),
+ * unless an announcement is ongoing. The receiver's request is then handled as
+ * usual with large_packet_send(). */
+int large_packet_push(
+    large_packet_t *large_packet,
+    const mira_net_address_t *dst);
+
+/* Push the registered large packet to dst, which subscribed to this node (see
+ * lp_subscription.h) at sub-packet period period_ms. As large_packet_push(),
+ * but for large packets of any number of sub-packets. */
+int large_packet_push_subscribed(
+    large_packet_t *large_packet,
+    const mira_net_address_t *dst,
+    const uint16_t period_ms);
+
+/* Signal the registered large packet to dst, until the receiver replies with a
+ * request, which is handled as usual with large_packet_send(). A receiver which
+ * defers its request can acknowledge the signal instead, with an empty
+ * lpack_send(). The signal is sent with jitter and repeated with randomized
+ * exponential backoff, see LARGE_PACKET_ANNOUNCE_*. If the receiver never
+ * replies, event_lp_sent is posted, not completed. A new announcement replaces
+ * the ongoing one.
+ *
+ * If a transfer is ongoing, the large packet is pipelined behind it: the signal
+ * is sent without jitter at the tail of the transfer, when its sub-packets are
+ * sent, so that the receiver can request it right after completion. */
+int large_packet_announce(
+    large_packet_t *large_packet,
+    const mira_net_address_t *dst);
+
+/* Announce the n_large_packets registered large packets of large_packets to
+ * dst together, as large_packet_announce(), with one batch signal while
+ * several of them wait for a reply (see lpsig_batch_send()). At most
+ * LPSIG_BATCH_MAX_ENTRIES. Each large packet is replied to, and requested, on
+ * its own. */
+int large_packet_announce_batch(
+    large_packet_t *const *large_packets,
+    const uint8_t n_large_packets,
+    const mira_net_address_t *dst);
+
+/* Distribute the registered large packet to all members of a multicast group.
+ * Each sub-packet is sent once to the group, after a push signal. Receivers
+ * report their missing sub-packets with requests, which are merged into the
+ * next repair round. Distribution ends once a round gets no report.
+ *
+ * Receivers must listen on LARGE_PACKET_RX_UDP_PORT, i.e. be initialized with
+ * role LARGE_PACKET_RECEIVER. */
+int large_packet_multicast(
+    large_packet_t *large_packet,
+    const mira_net_address_t *group);
+
 /* Request sub-packets from dst, only the sub-packets defined by sub_packet_mask
  * bit at 1. */
 int large_packet_request(
@@ -79,6 +208,42 @@ int large_packet_request(
     const uint64_t sub_packet_mask,
     const uint16_t sub_packet_period_ms);
 
+/* Receive into a sink instead of a payload buffer: each sub-packet is handed
+ * to write_sub_packet as it arrives, at its offset in the object of its
+ * segment, and only the received mask is kept in RAM. Objects larger than a
+ * large packet are then received segment by segment. Call once, before
+ * large_packet_receive_prepare(). */
+int large_packet_register_rx_sink(
+    large_packet_t *lp,
+    large_packet_write_fn_t write_sub_packet,
+    void *ctx);
+
+/* Prepare for receiving large packet packet_id from src, into one of the
+ * n_slots large packets of slots, each with its own payload buffer or sink.
+ * Slots keep partial receptions, one per source and packet id: if a slot holds
+ * one of the same large packet, not older than LARGE_PACKET_RESUME_TIMEOUT_S,
+ * the reception resumes in it: already received sub-packets are kept.
+ * Otherwise an empty slot, or else the one received into the longest ago, is
+ * reset, keeping its payload buffer or sink. Stops any ongoing reception, whose
+ * partial state stays in its slot.
+ *
+ * segment is the signaled segment, which places the sub-packets in a sink, see
+ * large_packet_write_fn_t. A payload buffer holds one segment whatever its
+ * number. lp is set to the slot to start large_packet_receive_proc with, request_mask
+ * to the sub-packets left to request. Returns 1 if the reception resumes, 0 if
+ * it starts over, negative on error. */
+int large_packet_receive_prepare(
+    large_packet_t *slots,
+    const uint8_t n_slots,
+    const mira_net_address_t *src,
+    const uint16_t src_port,
+    const uint16_t packet_id,
+    const uint8_t n_sub_packets,
+    const uint16_t segment,
+    const uint16_t period_ms,
+    large_packet_t **lp,
+    uint64_t *request_mask);
+
 /* Start this process upon sending requests, to handle reception. */
 PROCESS_NAME(large_packet_receive_proc);
 
@@ -0,0 +1,135 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <mira.h>
+#include <string.h>
+
+#include "large_packet.h"
+#include "lp_ack.h"
+#include "lp_budget.h"
+#include "lp_codec.h"
+#include "lp_dispatch.h"
+#include "lp_events.h"
+#include "lp_prof.h"
+#include "lp_wire.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+#define LPTR_MODULE LPTR_MODULE_LPACK
+#include "lp_trace.h"
+
+// ******************************************************************************
+// Global variables
+// ******************************************************************************
+process_event_t event_lp_acked;
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static mira_net_udp_connection_t *lpack_udp_connection;
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int lpack_init(
+    mira_net_udp_connection_t *udp_connection)
+{
+    event_lp_acked = process_alloc_event();
+
+    lpack_udp_connection = udp_connection;
+
+    return 0;
+}
+
+int lpack_send(
+    const mira_net_address_t *dst,
+    const uint16_t dst_port,
+    const uint16_t packet_id,
+    const uint64_t received_mask)
+{
+    LPTR_DEBUG(LPTR_EV_ACK_TX,
+        packet_id,
+        (uint32_t) (received_mask & UINT32_MAX),
+        (uint32_t) (received_mask >> 32));
+
+    const lpack_msg_t msg = {
+        .packet_id = packet_id,
+        .mask = received_mask,
+    };
+    uint8_t ack_buffer[LPC_HEADER_SIZE + sizeof(msg)];
+    int len;
+
+    LPPROF_START(LPPROF_LPACK_PACK);
+    len = lpc_encode(&lpack_schema, &msg, ack_buffer, sizeof(ack_buffer));
+    LPPROF_STOP(LPPROF_LPACK_PACK);
+
+    if (len < 0) {
+        P_ERR("%s: lpc_encode\n", __func__);
+        return -1;
+    }
+
+    mira_status_t ret =
+        mira_net_udp_send_to(
+            lpack_udp_connection,
+            dst,
+            dst_port,
+            ack_buffer,
+            len);
+
+    if (ret != MIRA_SUCCESS) {
+        P_ERR("[%d]: mira_net_udp_send_to\n", ret);
+        return -1;
+    }
+    lpb_charge(len);
+    return 0;
+}
+
+void lpack_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata)
+{
+    if (!lpc_match(&lpack_schema, data, data_len)) {
+        /* Not an ack packet */
+        return;
+    }
+
+    lpack_msg_t msg;
+    LPPROF_START(LPPROF_LPACK_UNPACK);
+    if (lpc_decode(&lpack_schema, &msg, data, data_len) < 0) {
+        P_ERR("%s: wrong lp ack packet size (%d)!\n", __func__, data_len);
+        return;
+    }
+    LPPROF_STOP(LPPROF_LPACK_UNPACK);
+
+    LPTR_DEBUG(LPTR_EV_ACK_RX,
+        msg.packet_id,
+        (uint32_t) (msg.mask & UINT32_MAX),
+        (uint32_t) (msg.mask >> 32));
+
+    /* Queue event with data */
+    lpd_entry_t *entry = lpd_entry_reserve();
+    if (entry == NULL) {
+        P_ERR("%s: event queue full\n", __func__);
+        return;
+    }
+
+    entry->data.acked = (lp_event_acked_data_t) {
+        .packet_id = msg.packet_id,
+        .mask = msg.mask,
+        .src_port = metadata->source_port,
+    };
+    memcpy(
+        &entry->data.acked.src,
+        metadata->source_address,
+        sizeof(mira_net_address_t));
+
+    lpd_entry_commit(
+        entry,
+        event_lp_acked,
+        &entry->data.acked.src,
+        msg.packet_id);
+}
@@ -0,0 +1,35 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_ACK_H
+#define LP_ACK_H
+
+/* Function identifier prefix: lpack_ */
+
+#include <stdint.h>
+
+#include "large_packet.h"
+
+int lpack_init(
+    mira_net_udp_connection_t *udp_connection);
+
+/* Report the sub-packets received so far of a large packet, back to its
+ * sender. A mask with all sub-packets set acknowledges the whole large
+ * packet. */
+int lpack_send(
+    const mira_net_address_t *dst,
+    const uint16_t port,
+    const uint16_t packet_id,
+    const uint64_t received_mask);
+
+/* Handle incoming data, if relevant. This function first tests if the data is a
+ * valid acknowledgement message. If it is, it acts by posting an event. */
+void lpack_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata);
+
+#endif
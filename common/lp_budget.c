@@ -0,0 +1,122 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <mira.h>
+#include <stdint.h>
+
+#include "lp_budget.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+#define LPTR_MODULE LPTR_MODULE_LPB
+#include "lp_trace.h"
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+
+/* Tokens are kept in bytes * CLOCK_SECOND, so that refilling by whole clock
+ * ticks is exact. Negative when in debt. */
+static int64_t lpb_tokens;
+static int64_t lpb_max_tokens;
+static uint32_t lpb_rate;
+static clock_time_t lpb_last_refill;
+
+static lpb_stats_t lpb_stats;
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static void lpb_refill(
+    void);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int lpb_init(
+    void)
+{
+    lpb_stats = (lpb_stats_t) { 0 };
+    lpb_config_set(LARGE_PACKET_AIRTIME_RATE_BPS, LARGE_PACKET_AIRTIME_BURST_BYTES);
+    lpb_tokens = lpb_max_tokens;
+    lpb_last_refill = clock_time();
+
+    return 0;
+}
+
+void lpb_config_set(
+    uint32_t rate_bytes_per_s,
+    uint32_t burst_bytes)
+{
+    lpb_refill();
+
+    lpb_rate = rate_bytes_per_s > 0 ? rate_bytes_per_s : 1;
+    lpb_max_tokens = (int64_t) burst_bytes * CLOCK_SECOND;
+    if (lpb_tokens > lpb_max_tokens) {
+        lpb_tokens = lpb_max_tokens;
+    }
+}
+
+clock_time_t lpb_delay(
+    uint16_t len)
+{
+    int64_t needed = (int64_t) (len + LPB_DATAGRAM_OVERHEAD) * CLOCK_SECOND;
+
+    lpb_refill();
+
+    if (lpb_tokens >= needed) {
+        return 0;
+    }
+    /* Round up, to not wake up before the tokens are there */
+    return (needed - lpb_tokens + lpb_rate - 1) / lpb_rate;
+}
+
+void lpb_charge(
+    uint16_t len)
+{
+    lpb_refill();
+
+    lpb_tokens -= (int64_t) (len + LPB_DATAGRAM_OVERHEAD) * CLOCK_SECOND;
+    lpb_stats.n_datagrams++;
+    lpb_stats.n_bytes += len + LPB_DATAGRAM_OVERHEAD;
+}
+
+void lpb_delay_record(
+    clock_time_t delay)
+{
+    uint32_t delay_ms = (uint64_t) delay * 1000 / CLOCK_SECOND;
+
+    if (delay == 0) {
+        return;
+    }
+    LPTR_DEBUG(LPTR_EV_BUDGET_WAIT, 0, delay_ms, 0);
+    lpb_stats.n_delayed++;
+    lpb_stats.total_delay_ms += delay_ms;
+    if (delay_ms > lpb_stats.max_delay_ms) {
+        lpb_stats.max_delay_ms = delay_ms;
+    }
+}
+
+void lpb_stats_get(
+    lpb_stats_t *stats)
+{
+    *stats = lpb_stats;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static void lpb_refill(
+    void)
+{
+    clock_time_t now = clock_time();
+
+    lpb_tokens += (int64_t) (clock_time_t) (now - lpb_last_refill) * lpb_rate;
+    if (lpb_tokens > lpb_max_tokens) {
+        lpb_tokens = lpb_max_tokens;
+    }
+    lpb_last_refill = now;
+}
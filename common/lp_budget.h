@@ -0,0 +1,73 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_BUDGET_H
+#define LP_BUDGET_H
+
+/* Function identifier prefix: lpb_ */
+
+/* Node-wide airtime budget, as a token bucket in bytes. Every datagram sent by
+ * the large packet modules is charged to the bucket, whatever the transfer it
+ * belongs to. Sub-packet transmissions wait for the bucket to hold enough
+ * tokens, on top of the period requested by the receiver. Control messages
+ * (signals, requests, cancels, acks) are small, and are sent at once, possibly
+ * leaving the bucket in debt, which delays the following sub-packets.
+ *
+ * Applications sending their own traffic can share the budget with
+ * lpb_delay() and lpb_charge(). */
+
+#include <mira.h>
+#include <stdint.h>
+
+/* Sustained rate, in bytes per second */
+#ifndef LARGE_PACKET_AIRTIME_RATE_BPS
+#define LARGE_PACKET_AIRTIME_RATE_BPS (1000)
+#endif
+
+/* Largest burst, in bytes */
+#ifndef LARGE_PACKET_AIRTIME_BURST_BYTES
+#define LARGE_PACKET_AIRTIME_BURST_BYTES (2048)
+#endif
+
+/* Bytes charged per datagram on top of its UDP payload: compressed IPv6 and UDP
+ * headers, MAC header and security overhead. */
+#define LPB_DATAGRAM_OVERHEAD (40)
+
+typedef struct {
+    uint32_t n_datagrams;
+    uint32_t n_bytes;
+    /* Transmissions which waited for budget, and their waiting time */
+    uint32_t n_delayed;
+    uint32_t total_delay_ms;
+    uint32_t max_delay_ms;
+} lpb_stats_t;
+
+/* Start with a full bucket. */
+int lpb_init(
+    void);
+
+/* Change rate and burst. The tokens are kept, up to the new burst. */
+void lpb_config_set(
+    uint32_t rate_bytes_per_s,
+    uint32_t burst_bytes);
+
+/* Clock ticks to wait before a datagram of len bytes (UDP payload) can be sent,
+ * 0 if it can be sent now. Nothing is charged. */
+clock_time_t lpb_delay(
+    uint16_t len);
+
+/* Charge a datagram of len bytes (UDP payload), as sent. */
+void lpb_charge(
+    uint16_t len);
+
+/* Record the time a transmission waited for budget. */
+void lpb_delay_record(
+    clock_time_t delay);
+
+void lpb_stats_get(
+    lpb_stats_t *stats);
+
+#endif
@@ -0,0 +1,181 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <mira.h>
+#include <string.h>
+
+#include "large_packet.h"
+#include "lp_coalesce.h"
+#include "lp_timer.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static void lpco_seal(
+    lpco_t *co);
+
+static void lpco_age_expired(
+    lpt_timer_t *timer);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int lpco_init(
+    lpco_t *co,
+    uint8_t *buffer_a,
+    uint8_t *buffer_b,
+    uint16_t buffer_size,
+    uint16_t seal_len,
+    clock_time_t max_age,
+    lpco_sealed_fn_t sealed,
+    void *ctx)
+{
+    if (buffer_size
+        > LARGE_PACKET_SUBPACKET_MAX_BYTES * LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS
+        || seal_len > buffer_size
+    ) {
+        P_ERR("%s: wrong sizes (%d, %d)\n", __func__, buffer_size, seal_len);
+        return -1;
+    }
+
+    *co = (lpco_t) {
+        .buffers = { buffer_a, buffer_b },
+        .buffer_size = buffer_size,
+        .seal_len = seal_len,
+        .max_age = max_age,
+        .sealed = sealed,
+        .ctx = ctx,
+    };
+
+    return 0;
+}
+
+int lpco_append(
+    lpco_t *co,
+    const void *record,
+    uint16_t len)
+{
+    if (len == 0
+        || len > LPCO_RECORD_MAX_BYTES
+        || LPCO_RECORD_HEADER_SIZE + len > co->buffer_size
+    ) {
+        co->n_rejected++;
+        return -1;
+    }
+
+    if (co->len + LPCO_RECORD_HEADER_SIZE + len > co->buffer_size) {
+        lpco_seal(co);
+        if (co->len != 0) {
+            /* Still pending, the other buffer is in transfer */
+            co->n_rejected++;
+            return -1;
+        }
+    }
+
+    uint8_t *p = co->buffers[co->filling] + co->len;
+    p[0] = len;
+    memcpy(p + LPCO_RECORD_HEADER_SIZE, record, len);
+
+    if (co->len == 0) {
+        lpt_set_callback(&co->age_timer, co->max_age, lpco_age_expired, co);
+    }
+    co->len += LPCO_RECORD_HEADER_SIZE + len;
+    co->n_records++;
+
+    if (co->len >= co->seal_len) {
+        lpco_seal(co);
+    }
+
+    return 0;
+}
+
+void lpco_flush(
+    lpco_t *co)
+{
+    if (co->len != 0) {
+        lpco_seal(co);
+    }
+}
+
+void lpco_release(
+    lpco_t *co)
+{
+    co->in_transfer = false;
+
+    if (co->seal_pending) {
+        lpco_seal(co);
+    }
+}
+
+void lpco_iter_init(
+    lpco_iter_t *it,
+    const uint8_t *payload,
+    uint16_t len)
+{
+    it->p = payload;
+    it->end = payload + len;
+}
+
+int lpco_iter_next(
+    lpco_iter_t *it,
+    const uint8_t **record)
+{
+    uint8_t len;
+
+    if (it->p == it->end) {
+        return 0;
+    }
+
+    len = it->p[0];
+    if (len == 0 || len > it->end - it->p - LPCO_RECORD_HEADER_SIZE) {
+        return -1;
+    }
+
+    *record = it->p + LPCO_RECORD_HEADER_SIZE;
+    it->p += LPCO_RECORD_HEADER_SIZE + len;
+
+    return len;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+
+/* Hand the pending large packet to the application, and go on filling the
+ * other buffer. Deferred until lpco_release() while the other buffer is in
+ * transfer. */
+static void lpco_seal(
+    lpco_t *co)
+{
+    if (co->in_transfer) {
+        co->seal_pending = true;
+        return;
+    }
+
+    uint8_t *payload = co->buffers[co->filling];
+    uint16_t len = co->len;
+
+    lpt_stop(&co->age_timer);
+    co->seal_pending = false;
+    co->in_transfer = true;
+    co->filling ^= 1;
+    co->len = 0;
+    co->n_sealed++;
+
+    co->sealed(co->ctx, payload, len);
+}
+
+static void lpco_age_expired(
+    lpt_timer_t *timer)
+{
+    lpco_t *co = timer->ptr;
+
+    if (co->len != 0) {
+        lpco_seal(co);
+    }
+}
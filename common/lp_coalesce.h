@@ -0,0 +1,127 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_COALESCE_H
+#define LP_COALESCE_H
+
+/* Function identifier prefix: lpco_ */
+
+/* Coalescing of small application records into large packets. The sender
+ * appends records to a pending large packet, which is sealed once it holds
+ * seal_len bytes, or once its first record is max_age old. The sealed large
+ * packet is handed to the application, to register and send it, while the
+ * next records go to a second buffer. The receiver splits a received large
+ * packet back into records with an iterator.
+ *
+ * Payload format: each record is its length (8 bits) followed by its bytes.
+ *
+ * Example, on the sender:
+ *
+ *   static void sealed(void *ctx, uint8_t *payload, uint16_t len)
+ *   {
+ *       large_packet_register_tx(&lp, packet_id++, payload, len);
+ *       large_packet_announce(&lp, &root);
+ *   }
+ *
+ *   lpco_init(&co, buffer_a, buffer_b, sizeof(buffer_a), 1000,
+ *       10 * CLOCK_SECOND, sealed, NULL);
+ *   lpco_append(&co, record, record_len);
+ *   ...
+ *   on event_lp_sent: lpco_release(&co);
+ *
+ * On the receiver:
+ *
+ *   lpco_iter_init(&it, lp->payload, lp->len);
+ *   while ((len = lpco_iter_next(&it, &record)) > 0) { ... }
+ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lp_timer.h"
+
+/* Bytes taken by the record length, in front of each record */
+#define LPCO_RECORD_HEADER_SIZE (1)
+
+/* Largest record */
+#define LPCO_RECORD_MAX_BYTES (255)
+
+/* Called with a sealed large packet. The payload stays valid until
+ * lpco_release(). */
+typedef void (*lpco_sealed_fn_t)(
+    void *ctx,
+    uint8_t *payload,
+    uint16_t len);
+
+typedef struct {
+    uint8_t *buffers[2];
+    uint16_t buffer_size;
+    uint16_t seal_len;
+    clock_time_t max_age;
+    lpco_sealed_fn_t sealed;
+    void *ctx;
+    uint8_t filling; /* index of the buffer records are appended to */
+    uint16_t len; /* bytes in the buffer being filled */
+    bool in_transfer; /* the other buffer is sealed, and not released yet */
+    bool seal_pending; /* to seal as soon as the other buffer is released */
+    lpt_timer_t age_timer;
+    /* Statistics */
+    uint32_t n_records;
+    uint32_t n_sealed;
+    uint32_t n_rejected; /* records not appended, for lack of room */
+} lpco_t;
+
+/* Splits a large packet into records */
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+} lpco_iter_t;
+
+/* Initialize co with two buffers of buffer_size bytes each, at most the size
+ * of a large packet. A pending large packet is sealed when it holds at least
+ * seal_len bytes, or when its first record is max_age clock ticks old. */
+int lpco_init(
+    lpco_t *co,
+    uint8_t *buffer_a,
+    uint8_t *buffer_b,
+    uint16_t buffer_size,
+    uint16_t seal_len,
+    clock_time_t max_age,
+    lpco_sealed_fn_t sealed,
+    void *ctx);
+
+/* Append a record of len bytes. The pending large packet is sealed first if
+ * the record does not fit. Returns 0, or -1 if there is no room for it: both
+ * buffers are in use, or len exceeds LPCO_RECORD_MAX_BYTES. Records are not
+ * empty, a len of 0 is rejected too, as it would read as the end of the large
+ * packet on the receiver. */
+int lpco_append(
+    lpco_t *co,
+    const void *record,
+    uint16_t len);
+
+/* Seal the pending large packet now, if it holds any record. */
+void lpco_flush(
+    lpco_t *co);
+
+/* The transfer of the sealed large packet ended, its buffer can be reused. A
+ * pending large packet which reached a threshold meanwhile is sealed now. */
+void lpco_release(
+    lpco_t *co);
+
+void lpco_iter_init(
+    lpco_iter_t *it,
+    const uint8_t *payload,
+    uint16_t len);
+
+/* Get the next record. Returns its length, 0 after the last record, or -1 if
+ * the payload is malformed, an empty record included. */
+int lpco_iter_next(
+    lpco_iter_t *it,
+    const uint8_t **record);
+
+#endif
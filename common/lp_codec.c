@@ -0,0 +1,319 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+
+#include "lp_codec.h"
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static uint16_t lpc_fields_size(
+    const lpc_schema_t *schema,
+    const uint8_t *msg);
+
+static uint8_t *lpc_fields_encode(
+    const lpc_schema_t *schema,
+    const uint8_t *msg,
+    uint8_t *p,
+    const uint8_t *end);
+
+static const uint8_t *lpc_fields_decode(
+    const lpc_schema_t *schema,
+    uint8_t *msg,
+    const uint8_t *p,
+    const uint8_t *end);
+
+static uint16_t lpc_bytes_len(
+    const lpc_field_t *field,
+    const uint8_t *msg);
+
+static uint8_t lpc_records_count(
+    const lpc_field_t *field,
+    const uint8_t *msg);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int lpc_match(
+    const lpc_schema_t *schema,
+    const uint8_t *buffer,
+    uint16_t len)
+{
+    return len >= LPC_HEADER_SIZE
+           && buffer[0] == schema->header[0]
+           && buffer[1] == schema->header[1];
+}
+
+uint16_t lpc_encoded_size(
+    const lpc_schema_t *schema,
+    const void *msg)
+{
+    return LPC_HEADER_SIZE + lpc_fields_size(schema, msg);
+}
+
+int lpc_encode(
+    const lpc_schema_t *schema,
+    const void *msg,
+    uint8_t *buffer,
+    uint16_t buffer_size)
+{
+    uint8_t *p = buffer;
+
+    if (buffer_size < LPC_HEADER_SIZE) {
+        return -1;
+    }
+    *p++ = schema->header[0];
+    *p++ = schema->header[1];
+
+    p = lpc_fields_encode(schema, msg, p, buffer + buffer_size);
+    if (p == NULL) {
+        return -1;
+    }
+
+    return p - buffer;
+}
+
+int lpc_decode(
+    const lpc_schema_t *schema,
+    void *msg,
+    const uint8_t *buffer,
+    uint16_t len)
+{
+    const uint8_t *end = buffer + len;
+    const uint8_t *p;
+
+    if (!lpc_match(schema, buffer, len)) {
+        return -1;
+    }
+
+    p = lpc_fields_decode(schema, msg, buffer + LPC_HEADER_SIZE, end);
+
+    return p == end ? 0 : -1;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static uint16_t lpc_fields_size(
+    const lpc_schema_t *schema,
+    const uint8_t *msg)
+{
+    uint16_t size = 0;
+
+    for (int i = 0; i < schema->n_fields; ++i) {
+        const lpc_field_t *field = &schema->fields[i];
+
+        if (field->type == LPC_TYPE_BYTES || field->type == LPC_TYPE_TAIL) {
+            size += lpc_bytes_len(field, msg);
+        } else if (field->type == LPC_TYPE_RECORDS) {
+            uint8_t count = lpc_records_count(field, msg);
+
+            for (int r = 0; r < count; ++r) {
+                size += lpc_fields_size(
+                    field->records,
+                    msg + field->offset + r * field->record_size);
+            }
+        } else {
+            size += field->type;
+        }
+    }
+    return size;
+}
+
+/* Returns the end of the encoded fields, or NULL if they do not fit. */
+static uint8_t *lpc_fields_encode(
+    const lpc_schema_t *schema,
+    const uint8_t *msg,
+    uint8_t *p,
+    const uint8_t *end)
+{
+    for (int i = 0; i < schema->n_fields; ++i) {
+        const lpc_field_t *field = &schema->fields[i];
+        const uint8_t *f = msg + field->offset;
+
+        if (field->type == LPC_TYPE_BYTES || field->type == LPC_TYPE_TAIL) {
+            uint16_t len = lpc_bytes_len(field, msg);
+            const uint8_t *data;
+
+            memcpy(&data, f, sizeof(data));
+            if (len > field->max_len || len > end - p) {
+                return NULL;
+            }
+            memcpy(p, data, len);
+            p += len;
+            continue;
+        }
+
+        if (field->type == LPC_TYPE_RECORDS) {
+            uint8_t count = lpc_records_count(field, msg);
+
+            if (count > field->max_len) {
+                return NULL;
+            }
+            for (int r = 0; r < count && p != NULL; ++r) {
+                p = lpc_fields_encode(
+                    field->records,
+                    f + r * field->record_size,
+                    p,
+                    end);
+            }
+            if (p == NULL) {
+                return NULL;
+            }
+            continue;
+        }
+
+        if (field->type > end - p) {
+            return NULL;
+        }
+        switch (field->type) {
+        case 1:
+            *p = *f;
+            break;
+        case 2: {
+            uint16_t v;
+            memcpy(&v, f, sizeof(v));
+            p[0] = v;
+            p[1] = v >> 8;
+            break;
+        }
+        case 4: {
+            uint32_t v;
+            memcpy(&v, f, sizeof(v));
+            p[0] = v;
+            p[1] = v >> 8;
+            p[2] = v >> 16;
+            p[3] = v >> 24;
+            break;
+        }
+        case 8: {
+            uint64_t v;
+            memcpy(&v, f, sizeof(v));
+            for (int b = 0; b < 8; ++b) {
+                p[b] = v >> (8 * b);
+            }
+            break;
+        }
+        default:
+            return NULL;
+        }
+        p += field->type;
+    }
+
+    return p;
+}
+
+/* Returns the end of the decoded fields, or NULL if the buffer does not hold
+ * them. */
+static const uint8_t *lpc_fields_decode(
+    const lpc_schema_t *schema,
+    uint8_t *msg,
+    const uint8_t *p,
+    const uint8_t *end)
+{
+    for (int i = 0; i < schema->n_fields; ++i) {
+        const lpc_field_t *field = &schema->fields[i];
+        uint8_t *f = msg + field->offset;
+
+        if (field->type == LPC_TYPE_BYTES) {
+            /* The length field is decoded already, being earlier on the wire */
+            uint16_t bytes_len = lpc_bytes_len(field, msg);
+
+            if (bytes_len > field->max_len || bytes_len > end - p) {
+                return NULL;
+            }
+            memcpy(f, &p, sizeof(p));
+            p += bytes_len;
+            continue;
+        }
+
+        if (field->type == LPC_TYPE_TAIL) {
+            /* The length is implied by the end of the message */
+            uint16_t bytes_len = end - p;
+
+            if (bytes_len > field->max_len) {
+                return NULL;
+            }
+            memcpy(msg + field->len_offset, &bytes_len, sizeof(bytes_len));
+            memcpy(f, &p, sizeof(p));
+            p = end;
+            continue;
+        }
+
+        if (field->type == LPC_TYPE_RECORDS) {
+            /* So is the count field */
+            uint8_t count = lpc_records_count(field, msg);
+
+            if (count > field->max_len) {
+                return NULL;
+            }
+            for (int r = 0; r < count && p != NULL; ++r) {
+                p = lpc_fields_decode(
+                    field->records,
+                    f + r * field->record_size,
+                    p,
+                    end);
+            }
+            if (p == NULL) {
+                return NULL;
+            }
+            continue;
+        }
+
+        if (field->type > end - p) {
+            return NULL;
+        }
+        switch (field->type) {
+        case 1:
+            *f = *p;
+            break;
+        case 2: {
+            uint16_t v = p[0] | (uint16_t) p[1] << 8;
+            memcpy(f, &v, sizeof(v));
+            break;
+        }
+        case 4: {
+            uint32_t v = p[0]
+                         | (uint32_t) p[1] << 8
+                         | (uint32_t) p[2] << 16
+                         | (uint32_t) p[3] << 24;
+            memcpy(f, &v, sizeof(v));
+            break;
+        }
+        case 8: {
+            uint64_t v = 0;
+            for (int b = 7; b >= 0; --b) {
+                v = v << 8 | p[b];
+            }
+            memcpy(f, &v, sizeof(v));
+            break;
+        }
+        default:
+            return NULL;
+        }
+        p += field->type;
+    }
+
+    return p;
+}
+
+static uint16_t lpc_bytes_len(
+    const lpc_field_t *field,
+    const uint8_t *msg)
+{
+    uint16_t len;
+
+    memcpy(&len, msg + field->len_offset, sizeof(len));
+    return len;
+}
+
+static uint8_t lpc_records_count(
+    const lpc_field_t *field,
+    const uint8_t *msg)
+{
+    return msg[field->len_offset];
+}
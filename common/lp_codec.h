@@ -0,0 +1,143 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_CODEC_H
+#define LP_CODEC_H
+
+/* Function identifier prefix: lpc_ */
+
+/* Message codec, driven by a schema per message type. A schema is the 2 bytes
+ * header identifying the message, followed by a list of field descriptors, in
+ * wire order. Fields are little endian integers, a byte string whose length
+ * is given by an earlier integer field of the message, a byte string running to
+ * the end of the message, or an array of records whose count is given by an
+ * earlier uint8_t field. Records are described by a schema of their own, whose
+ * header is not used.
+ *
+ * Example:
+ *
+ *   typedef struct {
+ *       uint16_t packet_id;
+ *       uint16_t len;
+ *       const uint8_t *data;
+ *   } my_msg_t;
+ *
+ *   static const lpc_field_t my_fields[] = {
+ *       LPC_FIELD(my_msg_t, packet_id),
+ *       LPC_FIELD(my_msg_t, len),
+ *       LPC_BYTES(my_msg_t, data, len, 330),
+ *   };
+ *   static const lpc_schema_t my_schema = LPC_SCHEMA(0x12, 0x34, my_fields);
+ *
+ * Decoding validates the header, the total length and the bounds of byte
+ * strings, in one pass over the buffer. Byte strings are not copied: decoding
+ * points into the buffer, and encoding reads from the pointer.
+ *
+ * This module does not depend on Mira, so that it builds on the host too. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LPC_HEADER_SIZE (2)
+
+/* Field types. Integer types are their width in bytes. */
+#define LPC_TYPE_BYTES (0)
+#define LPC_TYPE_TAIL (0xfe)
+#define LPC_TYPE_RECORDS (0xff)
+
+struct lpc_schema;
+
+typedef struct {
+    uint8_t type;
+    uint16_t offset;
+    /* LPC_TYPE_BYTES, LPC_TYPE_TAIL: offset of the uint16_t length field, and
+     * bound.
+     * LPC_TYPE_RECORDS: offset of the uint8_t count field, and bound. */
+    uint16_t len_offset;
+    uint16_t max_len;
+    /* LPC_TYPE_RECORDS only: schema of a record, and size of a record in msg */
+    const struct lpc_schema *records;
+    uint16_t record_size;
+} lpc_field_t;
+
+typedef struct lpc_schema {
+    uint8_t header[LPC_HEADER_SIZE];
+    uint8_t n_fields;
+    const lpc_field_t *fields;
+} lpc_schema_t;
+
+/* Integer field (uint8_t to uint64_t) of message type T */
+#define LPC_FIELD(T, field) { \
+        .type = sizeof(((T *) 0)->field), \
+        .offset = offsetof(T, field), \
+}
+
+/* Byte string field (const uint8_t *) of message type T, of length given by
+ * the uint16_t field len_field, at most max_len */
+#define LPC_BYTES(T, field, len_field, max_len_) { \
+        .type = LPC_TYPE_BYTES, \
+        .offset = offsetof(T, field), \
+        .len_offset = offsetof(T, len_field), \
+        .max_len = max_len_, \
+}
+
+/* Byte string field (const uint8_t *) of message type T, running to the end
+ * of the message, at most max_len. Its length is in the uint16_t field
+ * len_field of the message, which is not on the wire. The last field. */
+#define LPC_TAIL(T, field, len_field, max_len_) { \
+        .type = LPC_TYPE_TAIL, \
+        .offset = offsetof(T, field), \
+        .len_offset = offsetof(T, len_field), \
+        .max_len = max_len_, \
+}
+
+/* Array field of message type T, holding up to max_count records in place,
+ * with their number in the uint8_t field count_field. record_schema describes
+ * a record. */
+#define LPC_RECORDS(T, field, count_field, max_count, record_schema) { \
+        .type = LPC_TYPE_RECORDS, \
+        .offset = offsetof(T, field), \
+        .len_offset = offsetof(T, count_field), \
+        .max_len = max_count, \
+        .records = &record_schema, \
+        .record_size = sizeof(((T *) 0)->field[0]), \
+}
+
+#define LPC_SCHEMA(header0, header1, fields_) { \
+        .header = { header0, header1 }, \
+        .n_fields = sizeof(fields_) / sizeof(fields_[0]), \
+        .fields = fields_, \
+}
+
+/* Tell if buffer holds a message of this schema, from its header. */
+int lpc_match(
+    const lpc_schema_t *schema,
+    const uint8_t *buffer,
+    uint16_t len);
+
+/* Size of msg once encoded. */
+uint16_t lpc_encoded_size(
+    const lpc_schema_t *schema,
+    const void *msg);
+
+/* Encode msg into buffer, header included. Returns the encoded length, or -1 if
+ * buffer is too small, or a byte string or an array of records too long. */
+int lpc_encode(
+    const lpc_schema_t *schema,
+    const void *msg,
+    uint8_t *buffer,
+    uint16_t buffer_size);
+
+/* Decode buffer into msg. Returns 0, or -1 if the header does not match, the
+ * length is not exactly the one of the message, or a byte string or an array
+ * of records is too long. */
+int lpc_decode(
+    const lpc_schema_t *schema,
+    void *msg,
+    const uint8_t *buffer,
+    uint16_t len);
+
+#endif
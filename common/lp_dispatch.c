@@ -0,0 +1,268 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <mira.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lp_dispatch.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+#define LPTR_MODULE LPTR_MODULE_LPD
+#include "lp_trace.h"
+
+// ******************************************************************************
+// Module types
+// ******************************************************************************
+typedef struct {
+    struct process *p; /* NULL for free slot */
+    process_event_t event;
+    bool any_peer;
+    mira_net_address_t peer;
+    int32_t packet_id;
+} lpd_subscription_t;
+
+// ******************************************************************************
+// Module constants
+// ******************************************************************************
+#if (LPD_QUEUE_DEPTH & (LPD_QUEUE_DEPTH - 1)) != 0 || LPD_QUEUE_DEPTH > 128
+#error "LPD_QUEUE_DEPTH must be a power of two, at most 128"
+#endif
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static lpd_entry_t lpd_queue[LPD_QUEUE_DEPTH];
+
+/* Free running counters. head is only written by the producer (UDP callback),
+ * tail only by the consumer (lpd_proc). volatile does not order the accesses
+ * to the entries around them: each side fences, with release before
+ * publishing its counter and acquire after reading the other's. The targets
+ * are single core, so compiler fences suffice. */
+static volatile uint8_t lpd_head;
+static volatile uint8_t lpd_tail;
+
+static lpd_stats_t lpd_stats;
+
+static lpd_subscription_t lpd_subscriptions[LPD_MAX_SUBSCRIPTIONS];
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+PROCESS(lpd_proc, "Dispatch received large packet messages");
+
+static bool lpd_subscription_matches(
+    lpd_subscription_t *sub,
+    process_event_t event,
+    const mira_net_address_t *peer,
+    uint16_t packet_id);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int lpd_init(
+    void)
+{
+    process_exit(&lpd_proc);
+
+    lpd_head = 0;
+    lpd_tail = 0;
+    lpd_stats = (lpd_stats_t) {
+        0
+    };
+    memset(lpd_subscriptions, 0, sizeof(lpd_subscriptions));
+
+    process_start(&lpd_proc, NULL);
+
+    return 0;
+}
+
+lpd_entry_t *lpd_entry_reserve(
+    void)
+{
+    if ((uint8_t) (lpd_head - lpd_tail) >= LPD_QUEUE_DEPTH) {
+        lpd_stats.n_overflows++;
+        LPTR_ERR(LPTR_EV_QUEUE_FULL, 0, lpd_stats.n_overflows, 0);
+        return NULL;
+    }
+    /* The consumer is done with the entry before it is overwritten */
+    __atomic_signal_fence(__ATOMIC_ACQUIRE);
+
+    return &lpd_queue[lpd_head % LPD_QUEUE_DEPTH];
+}
+
+void lpd_entry_commit(
+    lpd_entry_t *entry,
+    process_event_t event,
+    const mira_net_address_t *src,
+    uint16_t packet_id)
+{
+    entry->event = event;
+    entry->src = src;
+    entry->packet_id = packet_id;
+
+    /* Entry content must be in place before it becomes visible */
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    lpd_head++;
+
+    uint8_t depth = lpd_head - lpd_tail;
+    if (depth > lpd_stats.max_depth) {
+        lpd_stats.max_depth = depth;
+    }
+
+    process_poll(&lpd_proc);
+}
+
+int lpd_subscribe(
+    struct process *p,
+    process_event_t event,
+    const mira_net_address_t *peer,
+    int32_t packet_id)
+{
+    lpd_subscription_t *slot = NULL;
+
+    for (int i = 0; i < LPD_MAX_SUBSCRIPTIONS; ++i) {
+        lpd_subscription_t *sub = &lpd_subscriptions[i];
+
+        if (sub->p == p && sub->event == event) {
+            slot = sub;
+            break;
+        }
+        if (slot == NULL
+            && (sub->p == NULL || !process_is_running(sub->p))
+        ) {
+            slot = sub;
+        }
+    }
+
+    if (slot == NULL) {
+        P_ERR("%s: no free subscription\n", __func__);
+        return -1;
+    }
+
+    *slot = (lpd_subscription_t) {
+        .p = p,
+        .event = event,
+        .any_peer = peer == NULL,
+        .packet_id = packet_id,
+    };
+    if (peer != NULL) {
+        slot->peer = *peer;
+    }
+
+    return 0;
+}
+
+void lpd_unsubscribe(
+    struct process *p,
+    process_event_t event)
+{
+    for (int i = 0; i < LPD_MAX_SUBSCRIPTIONS; ++i) {
+        lpd_subscription_t *sub = &lpd_subscriptions[i];
+
+        if (sub->p == p && sub->event == event) {
+            sub->p = NULL;
+        }
+    }
+}
+
+int lpd_post(
+    process_event_t event,
+    process_data_t data,
+    const mira_net_address_t *peer,
+    uint16_t packet_id)
+{
+    int n_posted = 0;
+
+    /* A process has at most one subscription per event, see lpd_subscribe() */
+    for (int i = 0; i < LPD_MAX_SUBSCRIPTIONS; ++i) {
+        lpd_subscription_t *sub = &lpd_subscriptions[i];
+
+        if (!lpd_subscription_matches(sub, event, peer, packet_id)) {
+            continue;
+        }
+
+        if (process_post(sub->p, event, data) != PROCESS_ERR_OK) {
+            P_ERR("%s: process_post\n", __func__);
+        } else {
+            n_posted++;
+        }
+    }
+
+    return n_posted;
+}
+
+void lpd_stats_get(
+    lpd_stats_t *stats)
+{
+    *stats = lpd_stats;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+PROCESS_THREAD(lpd_proc, ev, data)
+{
+    static lpd_entry_t *entry;
+
+    PROCESS_BEGIN();
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+        while (lpd_head != lpd_tail) {
+            /* Entry content is read after the head published it */
+            __atomic_signal_fence(__ATOMIC_ACQUIRE);
+            entry = &lpd_queue[lpd_tail % LPD_QUEUE_DEPTH];
+
+            if (lpd_post(
+                entry->event,
+                &entry->data,
+                entry->src,
+                entry->packet_id) > 0
+            ) {
+                /* Events are delivered in order: once the pause is over, all
+                 * processes handled the event, and the entry can be reused. */
+                PROCESS_PAUSE();
+                lpd_stats.n_dispatched++;
+            } else {
+                lpd_stats.n_unsubscribed++;
+            }
+
+            /* Done with the entry before the producer may reuse it */
+            __atomic_signal_fence(__ATOMIC_RELEASE);
+            lpd_tail++;
+        }
+    }
+
+    PROCESS_END();
+}
+
+static bool lpd_subscription_matches(
+    lpd_subscription_t *sub,
+    process_event_t event,
+    const mira_net_address_t *peer,
+    uint16_t packet_id)
+{
+    if (sub->p == NULL || sub->event != event) {
+        return false;
+    }
+
+    if (!process_is_running(sub->p)) {
+        /* Subscriber exited */
+        sub->p = NULL;
+        return false;
+    }
+
+    if (!sub->any_peer
+        && memcmp(&sub->peer, peer, sizeof(mira_net_address_t)) != 0
+    ) {
+        return false;
+    }
+
+    return sub->packet_id == LPD_ANY_PACKET_ID || sub->packet_id == packet_id;
+}
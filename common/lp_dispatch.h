@@ -0,0 +1,106 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_DISPATCH_H
+#define LP_DISPATCH_H
+
+/* Function identifier prefix: lpd_ */
+
+#include <mira.h>
+#include <stdint.h>
+
+#include "large_packet.h"
+#include "lp_events.h"
+
+/* Number of received messages that can wait for processing. Messages arriving
+ * while the queue is full are dropped, and counted. Must be a power of two, at
+ * most 128. */
+#ifndef LPD_QUEUE_DEPTH
+#define LPD_QUEUE_DEPTH (4)
+#endif
+
+/* Max number of event subscriptions, for all processes */
+#ifndef LPD_MAX_SUBSCRIPTIONS
+#define LPD_MAX_SUBSCRIPTIONS (8)
+#endif
+
+/* Subscription filter matching all packet ids */
+#define LPD_ANY_PACKET_ID (-1)
+
+/* A received message, waiting to be posted as event */
+typedef struct {
+    process_event_t event;
+    /* Peer and packet id of the message, for subscription filters */
+    const mira_net_address_t *src;
+    uint16_t packet_id;
+    union {
+        lp_event_signaled_data_t signaled;
+        lp_event_requested_data_t requested;
+        lp_event_cancelled_data_t cancelled;
+        lp_event_subpacket_data_t subpacket;
+        lp_event_acked_data_t acked;
+        lp_event_subscribed_data_t subscribed;
+    } data;
+    /* Storage for the payload of a sub-packet */
+    uint8_t payload[LARGE_PACKET_SUBPACKET_MAX_BYTES];
+} lpd_entry_t;
+
+typedef struct {
+    uint32_t n_dispatched;
+    uint32_t n_unsubscribed; /* messages no process subscribed to */
+    uint32_t n_overflows; /* messages dropped because the queue was full */
+    uint8_t max_depth; /* highest number of messages waiting at once */
+} lpd_stats_t;
+
+/* Initialize the queue, and start dispatching its messages as events. Clears
+ * all subscriptions. */
+int lpd_init(
+    void);
+
+/* Get a free entry to fill in with a received message, or NULL if the queue
+ * is full. Only call from the UDP callback (single producer). */
+lpd_entry_t *lpd_entry_reserve(
+    void);
+
+/* Queue the entry from lpd_entry_reserve(), to be posted as event to the
+ * subscribed processes. src and packet_id identify the message for
+ * subscription filters, src must point into the entry. The event data points
+ * into the entry, and stays valid until all processes handled the event. */
+void lpd_entry_commit(
+    lpd_entry_t *entry,
+    process_event_t event,
+    const mira_net_address_t *src,
+    uint16_t packet_id);
+
+/* Subscribe process p to event. Only events from peer are posted to p, unless
+ * peer is NULL. Only events about packet_id are posted to p, unless packet_id
+ * is LPD_ANY_PACKET_ID. Subscribing again to the same event replaces the
+ * filter. Subscriptions of processes that exited are dropped. */
+int lpd_subscribe(
+    struct process *p,
+    process_event_t event,
+    const mira_net_address_t *peer,
+    int32_t packet_id);
+
+/* Remove the subscription of process p to event. */
+void lpd_unsubscribe(
+    struct process *p,
+    process_event_t event);
+
+/* Post event to the processes subscribed to it, and matching peer and
+ * packet_id. For events generated in process context. Returns the number of
+ * processes posted to. */
+int lpd_post(
+    process_event_t event,
+    process_data_t data,
+    const mira_net_address_t *peer,
+    uint16_t packet_id);
+
+/* Get queue statistics since initialization. */
+void lpd_stats_get(
+    lpd_stats_t *stats);
+
+#endif
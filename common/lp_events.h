@@ -11,6 +11,13 @@ extern process_event_t event_lp_signaled_ready;
 typedef struct {
     uint8_t n_sub_packets;
     uint16_t packet_id;
+    /* true if sub-packets are pushed by the sender, without request */
+    bool push;
+    /* true if pushed to a subscriber, at the sub-packet period it subscribed
+     * with */
+    bool subscribed;
+    /* Segment of a larger object, see LARGE_PACKET_SEGMENT_MAX_BYTES */
+    uint16_t segment;
     mira_net_address_t src;
     uint16_t src_port;
 } lp_event_signaled_data_t;
@@ -21,11 +28,32 @@ typedef struct {
     uint16_t packet_id;
     uint64_t mask;
     uint16_t period_ms;
+    /* handle for compact sub-packets, or LPREQ_NO_SESSION */
+    uint8_t session;
     /* source and port of the request, used as destination for large packet */
     mira_net_address_t src;
     uint16_t src_port;
 } lp_event_requested_data_t;
 
+/* Event: received a subscription to the large packets of this node */
+extern process_event_t event_lp_subscribed;
+typedef struct {
+    uint16_t period_ms;
+    /* 0 to end the subscription */
+    uint16_t lifetime_s;
+    /* subscriber, destination of the pushed large packets */
+    mira_net_address_t src;
+    uint16_t src_port;
+} lp_event_subscribed_data_t;
+
+/* Event: received a cancel of a request for large packet */
+extern process_event_t event_lp_cancelled;
+typedef struct {
+    uint16_t packet_id;
+    mira_net_address_t src;
+    uint16_t src_port;
+} lp_event_cancelled_data_t;
+
 /* Event: received a sub-packet */
 extern process_event_t event_lp_subpacket_received;
 typedef struct {
@@ -38,7 +66,24 @@ typedef struct {
     uint16_t src_port;
 } lp_event_subpacket_data_t;
 
-/* Event: received a large packet */
+/* Event: received an acknowledgement of sub-packets, from the receiver */
+extern process_event_t event_lp_acked;
+typedef struct {
+    uint16_t packet_id;
+    uint64_t mask; /* bit 1 for sub-packets received so far */
+    mira_net_address_t src;
+    uint16_t src_port;
+} lp_event_acked_data_t;
+
+/* Event: received a large packet. Data: the large_packet_t */
 extern process_event_t event_lp_received;
 
+/* Event: transmission of a large packet ended */
+extern process_event_t event_lp_sent;
+typedef struct {
+    uint16_t packet_id;
+    /* true if the receiver acknowledged the whole large packet */
+    bool completed;
+} lp_event_sent_data_t;
+
 #endif
@@ -0,0 +1,132 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+
+#include "lp_frame.h"
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static void lpfr_encode_byte(
+    lpfr_encoder_t *enc,
+    uint8_t byte);
+
+static void lpfr_block_flush(
+    lpfr_encoder_t *enc);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+void lpfr_encode_begin(
+    lpfr_encoder_t *enc,
+    lpfr_write_fn_t write,
+    void *ctx)
+{
+    const uint8_t delimiter = LPFR_DELIMITER;
+
+    enc->write = write;
+    enc->ctx = ctx;
+    enc->crc = 0xffff;
+    enc->block_len = 1;
+
+    /* Terminate anything else written to the line since the last frame */
+    enc->write(enc->ctx, &delimiter, 1);
+}
+
+void lpfr_encode_bytes(
+    lpfr_encoder_t *enc,
+    const uint8_t *data,
+    uint16_t len)
+{
+    enc->crc = lpfr_crc16(enc->crc, data, len);
+
+    for (uint16_t i = 0; i < len; ++i) {
+        lpfr_encode_byte(enc, data[i]);
+    }
+}
+
+void lpfr_encode_end(
+    lpfr_encoder_t *enc)
+{
+    const uint8_t delimiter = LPFR_DELIMITER;
+    uint16_t crc = enc->crc;
+
+    lpfr_encode_byte(enc, crc & 0xff);
+    lpfr_encode_byte(enc, crc >> 8);
+
+    lpfr_block_flush(enc);
+    enc->write(enc->ctx, &delimiter, 1);
+}
+
+void lpfr_write_large_packet(
+    lpfr_write_fn_t write,
+    void *ctx,
+    const uint8_t src[LPFR_ADDRESS_SIZE],
+    uint16_t packet_id,
+    const uint8_t *payload,
+    uint16_t len)
+{
+    lpfr_encoder_t enc;
+    uint8_t header[LPFR_HEADER_SIZE];
+    uint8_t *p = header;
+
+    *p++ = LPFR_TYPE_LARGE_PACKET;
+    memcpy(p, src, LPFR_ADDRESS_SIZE);
+    p += LPFR_ADDRESS_SIZE;
+    *p++ = packet_id & 0xff;
+    *p++ = packet_id >> 8;
+    *p++ = len & 0xff;
+    *p++ = len >> 8;
+
+    lpfr_encode_begin(&enc, write, ctx);
+    lpfr_encode_bytes(&enc, header, sizeof(header));
+    lpfr_encode_bytes(&enc, payload, len);
+    lpfr_encode_end(&enc);
+}
+
+uint16_t lpfr_crc16(
+    uint16_t crc,
+    const uint8_t *data,
+    uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i) {
+        crc ^= (uint16_t) data[i] << 8;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static void lpfr_encode_byte(
+    lpfr_encoder_t *enc,
+    uint8_t byte)
+{
+    if (byte == 0) {
+        /* A zero ends the block; its position is given by the code byte */
+        lpfr_block_flush(enc);
+        return;
+    }
+
+    enc->block[enc->block_len++] = byte;
+
+    if (enc->block_len == 0xff) {
+        /* Full block, without implicit zero */
+        lpfr_block_flush(enc);
+    }
+}
+
+static void lpfr_block_flush(
+    lpfr_encoder_t *enc)
+{
+    enc->block[0] = enc->block_len;
+    enc->write(enc->ctx, enc->block, enc->block_len);
+    enc->block_len = 1;
+}
@@ -0,0 +1,90 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_FRAME_H
+#define LP_FRAME_H
+
+/* Function identifier prefix: lpfr_ */
+
+/* Binary framing of received large packets, for output on a serial line.
+ *
+ * Frame content, before encoding:
+ *
+ *  +---------------+------------------------+----------------------+----------------+
+ *  | type (8 bits) | source addr (128 bits) | packet_id (16 bits)  | len (16 bits)  | ...
+ *  +---------------+------------------------+----------------------+----------------+
+ *
+ *  +-----------------------+-------------+
+ *  | payload (len bytes)   | crc16 (16)  |
+ *  +-----------------------+-------------+
+ *
+ * Little endian. crc16 is CRC-16/CCITT-FALSE over all preceding bytes. The
+ * content is COBS encoded, and each frame is enclosed by 0x00 bytes, which
+ * appear nowhere else in the stream. A reader may start at any point and
+ * resynchronize on the next 0x00. Other output on the same line (e.g. debug
+ * text) is discarded by the reader, since it fails the CRC.
+ *
+ * This module does not depend on Mira, so that it builds on the host too. */
+
+#include <stdint.h>
+
+#define LPFR_TYPE_LARGE_PACKET (0x01)
+
+#define LPFR_ADDRESS_SIZE (16)
+#define LPFR_HEADER_SIZE (1 + LPFR_ADDRESS_SIZE + 2 + 2)
+#define LPFR_CRC_SIZE (2)
+
+/* Frame delimiter */
+#define LPFR_DELIMITER (0x00)
+
+/* Output function for encoded bytes */
+typedef void (*lpfr_write_fn_t)(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len);
+
+/* Streaming encoder. Frames are encoded on the fly, with a buffer of one COBS
+ * block only. */
+typedef struct {
+    lpfr_write_fn_t write;
+    void *ctx;
+    uint16_t crc;
+    uint8_t block_len;
+    uint8_t block[255]; /* block[0] is the COBS code byte */
+} lpfr_encoder_t;
+
+/* Start a new frame. */
+void lpfr_encode_begin(
+    lpfr_encoder_t *enc,
+    lpfr_write_fn_t write,
+    void *ctx);
+
+/* Add content to the frame. */
+void lpfr_encode_bytes(
+    lpfr_encoder_t *enc,
+    const uint8_t *data,
+    uint16_t len);
+
+/* Append the CRC, and terminate the frame. */
+void lpfr_encode_end(
+    lpfr_encoder_t *enc);
+
+/* Encode and write a whole large packet frame. */
+void lpfr_write_large_packet(
+    lpfr_write_fn_t write,
+    void *ctx,
+    const uint8_t src[LPFR_ADDRESS_SIZE],
+    uint16_t packet_id,
+    const uint8_t *payload,
+    uint16_t len);
+
+/* CRC-16/CCITT-FALSE, continued from crc. Start with 0xffff. */
+uint16_t lpfr_crc16(
+    uint16_t crc,
+    const uint8_t *data,
+    uint32_t len);
+
+#endif
@@ -0,0 +1,143 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#if defined(__linux__)
+/* clock_gettime() of the host build */
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lp_prof.h"
+
+// ******************************************************************************
+// Global variables
+// ******************************************************************************
+#if LP_PROF
+lpprof_probe_data_t lpprof_probes[LPPROF_COUNT];
+#endif
+
+// ******************************************************************************
+// Module constants
+// ******************************************************************************
+#if LP_PROF
+static const char *const lpprof_names[LPPROF_COUNT] = {
+    [LPPROF_UDP_CALLBACK] = "udp_callback",
+    [LPPROF_LPSIG_PACK] = "lpsig_pack",
+    [LPPROF_LPSIG_UNPACK] = "lpsig_unpack",
+    [LPPROF_LPREQ_PACK] = "lpreq_pack",
+    [LPPROF_LPREQ_UNPACK] = "lpreq_unpack",
+    [LPPROF_LPSP_PACK] = "lpsp_pack",
+    [LPPROF_LPSP_UNPACK] = "lpsp_unpack",
+    [LPPROF_LPACK_PACK] = "lpack_pack",
+    [LPPROF_LPACK_UNPACK] = "lpack_unpack",
+    [LPPROF_REASSEMBLY_COPY] = "reassembly_copy",
+    [LPPROF_SUBPACKET_SEND] = "subpacket_send",
+};
+
+#if defined(__linux__)
+#define LPPROF_TICKS_TO_NS(t) ((uint64_t) (t))
+#else
+#define LPPROF_TICKS_TO_NS(t) ((uint64_t) (t) * 1000000000UL / LP_PROF_CPU_HZ)
+#endif
+
+#if defined(__ARM_ARCH_6M__)
+#define LPPROF_SYST_CSR (*(volatile uint32_t *) 0xe000e010)
+#define LPPROF_SYST_CSR_ENABLE (1UL << 0)
+#define LPPROF_SYST_CSR_CLKSOURCE (1UL << 2)
+#define LPPROF_SYST_RELOAD_MAX (0xffffffUL)
+#elif !defined(__linux__)
+#define LPPROF_DWT_CTRL (*(volatile uint32_t *) 0xe0001000)
+#define LPPROF_DEMCR (*(volatile uint32_t *) 0xe000edfc)
+#define LPPROF_DEMCR_TRCENA (1UL << 24)
+#define LPPROF_DWT_CTRL_CYCCNTENA (1UL << 0)
+#endif
+#endif
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+void lpprof_init(
+    void)
+{
+#if LP_PROF && defined(__ARM_ARCH_6M__)
+    /* Free running, without interrupt, unless the system tick uses it */
+    if (!(LPPROF_SYST_CSR & LPPROF_SYST_CSR_ENABLE)) {
+        LPPROF_SYST_RVR = LPPROF_SYST_RELOAD_MAX;
+        LPPROF_SYST_CVR = 0;
+        LPPROF_SYST_CSR = LPPROF_SYST_CSR_CLKSOURCE | LPPROF_SYST_CSR_ENABLE;
+    }
+#elif LP_PROF && !defined(__linux__)
+    LPPROF_DEMCR |= LPPROF_DEMCR_TRCENA;
+    LPPROF_DWT_CTRL |= LPPROF_DWT_CTRL_CYCCNTENA;
+#endif
+    lpprof_reset();
+}
+
+void lpprof_reset(
+    void)
+{
+#if LP_PROF
+    memset(lpprof_probes, 0, sizeof(lpprof_probes));
+#endif
+}
+
+int lpprof_stats_get(
+    lpprof_probe_t probe,
+    lpprof_stats_t *stats)
+{
+#if LP_PROF
+    const lpprof_probe_data_t *p;
+
+    if (probe >= LPPROF_COUNT) {
+        return -1;
+    }
+    p = &lpprof_probes[probe];
+
+    *stats = (lpprof_stats_t) {
+        .n_samples = p->n_samples,
+        .min_ns = LPPROF_TICKS_TO_NS(p->min),
+        .max_ns = LPPROF_TICKS_TO_NS(p->max),
+        .mean_ns = p->n_samples
+            ? LPPROF_TICKS_TO_NS(p->total / p->n_samples)
+            : 0,
+    };
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+const char *lpprof_name(
+    lpprof_probe_t probe)
+{
+#if LP_PROF
+    if (probe < LPPROF_COUNT) {
+        return lpprof_names[probe];
+    }
+#endif
+    return "?";
+}
+
+void lpprof_print(
+    void)
+{
+#if LP_PROF
+    printf("%-16s %8s %10s %10s %10s\n", "probe", "n", "min ns", "mean ns", "max ns");
+    for (int i = 0; i < LPPROF_COUNT; ++i) {
+        lpprof_stats_t s;
+
+        lpprof_stats_get(i, &s);
+        printf("%-16s %8lu %10lu %10lu %10lu\n",
+            lpprof_names[i],
+            (unsigned long) s.n_samples,
+            (unsigned long) s.min_ns,
+            (unsigned long) s.mean_ns,
+            (unsigned long) s.max_ns);
+    }
+#endif
+}
@@ -0,0 +1,180 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_PROF_H
+#define LP_PROF_H
+
+/* Function identifier prefix: lpprof_ */
+
+/* Timing probes on the hot paths. Build with LP_PROF=1 to enable them; they
+ * compile to nothing otherwise.
+ *
+ * Probes read the DWT cycle counter on Cortex-M3/M4/M7 targets (e.g. nRF52),
+ * and clock_gettime() (in ns) on a Linux host, where the Linux receiver is
+ * probed. Cortex-M0/M0+ targets (e.g. MKW41Z) have no cycle counter, and read
+ * SysTick instead, at the core clock: it is started free running by
+ * lpprof_init() unless the system runs it already. A sample must then be
+ * shorter than a SysTick period, 2^24 cycles when free running.
+ *
+ * A probe must not be started again before it is stopped. Samples where the
+ * probe is not stopped (early return on errors) are not recorded. */
+
+#include <stdint.h>
+
+#ifndef LP_PROF
+#define LP_PROF (0)
+#endif
+
+/* Core clock, to convert cycles to time on target */
+#ifndef LP_PROF_CPU_HZ
+#if defined(__ARM_ARCH_6M__)
+#define LP_PROF_CPU_HZ (48000000UL)
+#else
+#define LP_PROF_CPU_HZ (64000000UL)
+#endif
+#endif
+
+typedef enum {
+    LPPROF_UDP_CALLBACK = 0,
+    LPPROF_LPSIG_PACK,
+    LPPROF_LPSIG_UNPACK,
+    LPPROF_LPREQ_PACK,
+    LPPROF_LPREQ_UNPACK,
+    LPPROF_LPSP_PACK,
+    LPPROF_LPSP_UNPACK,
+    LPPROF_LPACK_PACK,
+    LPPROF_LPACK_UNPACK,
+    LPPROF_REASSEMBLY_COPY,
+    LPPROF_SUBPACKET_SEND,
+    LPPROF_COUNT
+} lpprof_probe_t;
+
+/* Figures of a probe, in ns */
+typedef struct {
+    uint32_t n_samples;
+    uint32_t min_ns;
+    uint32_t max_ns;
+    uint32_t mean_ns;
+} lpprof_stats_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t n_samples;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+} lpprof_probe_data_t;
+
+#if LP_PROF
+
+extern lpprof_probe_data_t lpprof_probes[LPPROF_COUNT];
+
+#if defined(__linux__)
+#include <time.h>
+
+static inline uint32_t lpprof_now(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static inline uint32_t lpprof_elapsed(
+    uint32_t start,
+    uint32_t now)
+{
+    return now - start;
+}
+
+#elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define LPPROF_DWT_CYCCNT (*(volatile uint32_t *) 0xe0001004)
+
+static inline uint32_t lpprof_now(
+    void)
+{
+    return LPPROF_DWT_CYCCNT;
+}
+
+static inline uint32_t lpprof_elapsed(
+    uint32_t start,
+    uint32_t now)
+{
+    return now - start;
+}
+
+#elif defined(__ARM_ARCH_6M__)
+#define LPPROF_SYST_RVR (*(volatile uint32_t *) 0xe000e014)
+#define LPPROF_SYST_CVR (*(volatile uint32_t *) 0xe000e018)
+
+/* SysTick counts down from its reload value, turned into counting up */
+static inline uint32_t lpprof_now(
+    void)
+{
+    return LPPROF_SYST_RVR - LPPROF_SYST_CVR;
+}
+
+/* At most one wrap, at the reload value the system may have chosen */
+static inline uint32_t lpprof_elapsed(
+    uint32_t start,
+    uint32_t now)
+{
+    return now >= start
+        ? now - start
+        : now + LPPROF_SYST_RVR + 1 - start;
+}
+
+#else
+#error "LP_PROF needs a DWT cycle counter (ARMv7-M), SysTick (ARMv6-M) or a Linux host build"
+#endif
+
+static inline void lpprof_stop(
+    lpprof_probe_t probe)
+{
+    lpprof_probe_data_t *p = &lpprof_probes[probe];
+    uint32_t elapsed = lpprof_elapsed(p->start, lpprof_now());
+
+    if (p->n_samples == 0 || elapsed < p->min) {
+        p->min = elapsed;
+    }
+    if (elapsed > p->max) {
+        p->max = elapsed;
+    }
+    p->total += elapsed;
+    p->n_samples++;
+}
+
+#define LPPROF_START(probe) (lpprof_probes[probe].start = lpprof_now())
+#define LPPROF_STOP(probe) lpprof_stop(probe)
+
+#else
+#define LPPROF_START(probe)
+#define LPPROF_STOP(probe)
+#endif
+
+/* Enable the cycle counter, and reset all probes. Done by large_packet_init(),
+ * and lprx_open() on the host. */
+void lpprof_init(
+    void);
+
+void lpprof_reset(
+    void);
+
+/* Get figures of a probe. Returns -1 if profiling is compiled out. */
+int lpprof_stats_get(
+    lpprof_probe_t probe,
+    lpprof_stats_t *stats);
+
+/* Name of a probe, for printing. */
+const char *lpprof_name(
+    lpprof_probe_t probe);
+
+/* Print the figures of all probes, with printf. */
+void lpprof_print(
+    void);
+
+#endif
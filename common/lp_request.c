@@ -8,44 +8,50 @@ form without prior written permission from LumenRadio AB.
 #include <string.h>
 
 #include "large_packet.h"
+#include "lp_budget.h"
+#include "lp_codec.h"
+#include "lp_dispatch.h"
 #include "lp_events.h"
+#include "lp_prof.h"
+#include "lp_request.h"
+#include "lp_wire.h"
 
 #define DEBUG_LEVEL 2
 #include "utils.h"
 
+#define LPTR_MODULE LPTR_MODULE_LPREQ
+#include "lp_trace.h"
+
 // ******************************************************************************
 // Global variables
 // ******************************************************************************
 process_event_t event_lp_requested;
-
-// ******************************************************************************
-// Module constants
-// ******************************************************************************
-static const uint8_t lpreq_header[LP_HEADER_SIZE] = {
-    0xf2, 0x2a
-};
-
-static mira_net_udp_connection_t *lpreq_udp_connection;
+process_event_t event_lp_cancelled;
 
 // ******************************************************************************
 // Module variables
 // ******************************************************************************
+static mira_net_udp_connection_t *lpreq_udp_connection;
 
 // ******************************************************************************
 // Function prototypes
 // ******************************************************************************
-static void lpreq_pack_buffer(
-    uint8_t *buffer,
-    uint16_t packet_id,
-    uint64_t mask,
-    uint16_t period_ms);
-
-static int lpreq_unpack_buffer(
-    uint16_t *packet_id,
-    uint64_t *mask,
-    uint16_t *period_ms,
-    const uint8_t *buffer,
-    uint8_t len);
+static void lpreq_cancel_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata);
+
+static void lpreq_batch_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata);
+
+static void lpreq_requested_post(
+    const uint16_t packet_id,
+    const uint64_t mask,
+    const uint16_t period_ms,
+    const uint8_t session,
+    const mira_net_udp_callback_metadata_t *metadata);
 
 // ******************************************************************************
 // Function definitions
@@ -54,6 +60,7 @@ int lpreq_init(
     mira_net_udp_connection_t *udp_connection)
 {
     event_lp_requested = process_alloc_event();
+    event_lp_cancelled = process_alloc_event();
 
     lpreq_udp_connection = udp_connection;
 
@@ -65,36 +72,86 @@ int lpreq_send(
     const uint16_t dst_port,
     const uint16_t packet_id,
     const uint64_t sub_packet_mask,
-    const uint16_t sub_packet_period_ms)
+    const uint16_t sub_packet_period_ms,
+    const uint8_t session)
 {
-#if DEBUG_LEVEL > 0
-    char addr_str_buffer[MIRA_NET_MAX_ADDRESS_STR_LEN];
-#endif
-    P_DEBUG("Sending lp request to %s: id %d, mask 0x%08lx%08lx, period %d ms\n",
-        mira_net_toolkit_format_address(addr_str_buffer, dst),
+    LPTR_DEBUG(LPTR_EV_REQUEST_TX,
         packet_id,
-        (uint32_t) (sub_packet_mask >> 32),
         (uint32_t) (sub_packet_mask & UINT32_MAX),
-        sub_packet_period_ms);
+        (uint32_t) (sub_packet_mask >> 32));
 
-    uint8_t request_buffer[
-        sizeof(lpreq_header)
-        + sizeof(packet_id)
-        + sizeof(sub_packet_mask)
-        + sizeof(sub_packet_period_ms)
-    ];
+    const lpreq_msg_t msg = {
+        .packet_id = packet_id,
+        .mask = sub_packet_mask,
+        .period_ms = sub_packet_period_ms,
+        .session = session,
+    };
+    uint8_t request_buffer[LPC_HEADER_SIZE + sizeof(msg)];
+    int len;
 
-    lpreq_pack_buffer(
+    LPPROF_START(LPPROF_LPREQ_PACK);
+    len = lpc_encode(
+        session != LPREQ_NO_SESSION ? &lpreq_session_schema : &lpreq_schema,
+        &msg,
         request_buffer,
-        packet_id,
-        sub_packet_mask,
-        sub_packet_period_ms);
+        sizeof(request_buffer));
+    LPPROF_STOP(LPPROF_LPREQ_PACK);
+
+    if (len < 0) {
+        P_ERR("%s: lpc_encode\n", __func__);
+        return -1;
+    }
+
+    mira_status_t ret =
+        mira_net_udp_send_to(
+            lpreq_udp_connection,
+            dst,
+            dst_port,
+            request_buffer,
+            len);
+
+    if (ret != MIRA_SUCCESS) {
+        P_ERR("[%d]: mira_net_udp_send_to\n", ret);
+        return -1;
+    }
+    lpb_charge(len);
+    return 0;
+}
+
+int lpreq_batch_send(
+    const mira_net_address_t *dst,
+    const uint16_t dst_port,
+    const lpreq_entry_t *entries,
+    const uint8_t n_entries,
+    const uint16_t sub_packet_period_ms)
+{
+    lpreq_batch_msg_t msg;
+    uint8_t request_buffer[LPC_HEADER_SIZE + 3 + 10 * LPREQ_BATCH_MAX_ENTRIES];
+    int len;
+
+    if (n_entries > LPREQ_BATCH_MAX_ENTRIES) {
+        P_ERR("%s: too many entries (%d)\n", __func__, n_entries);
+        return -1;
+    }
 
-    P_DEBUG("Request buffer: ");
-    for (int i = 0; i < sizeof(request_buffer); ++i) {
-        P_DEBUG("0x%02x ", request_buffer[i]);
+    msg.period_ms = sub_packet_period_ms;
+    msg.n_entries = n_entries;
+    for (int i = 0; i < n_entries; ++i) {
+        msg.entries[i] = entries[i];
+        LPTR_DEBUG(LPTR_EV_REQUEST_TX,
+            entries[i].packet_id,
+            (uint32_t) (entries[i].sub_packet_mask & UINT32_MAX),
+            (uint32_t) (entries[i].sub_packet_mask >> 32));
+    }
+
+    LPPROF_START(LPPROF_LPREQ_PACK);
+    len = lpc_encode(&lpreq_batch_schema, &msg, request_buffer, sizeof(request_buffer));
+    LPPROF_STOP(LPPROF_LPREQ_PACK);
+
+    if (len < 0) {
+        P_ERR("%s: lpc_encode\n", __func__);
+        return -1;
     }
-    P_DEBUG("\n");
 
     mira_status_t ret =
         mira_net_udp_send_to(
@@ -102,12 +159,51 @@ int lpreq_send(
             dst,
             dst_port,
             request_buffer,
-            sizeof(request_buffer));
+            len);
 
     if (ret != MIRA_SUCCESS) {
         P_ERR("[%d]: mira_net_udp_send_to\n", ret);
         return -1;
     }
+    lpb_charge(len);
+    return 0;
+}
+
+int lpreq_cancel_send(
+    const mira_net_address_t *dst,
+    const uint16_t dst_port,
+    const uint16_t packet_id)
+{
+    LPTR_DEBUG(LPTR_EV_CANCEL_TX, packet_id, 0, 0);
+
+    const lpreq_cancel_msg_t msg = {
+        .packet_id = packet_id,
+    };
+    uint8_t cancel_buffer[LPC_HEADER_SIZE + sizeof(msg)];
+    int len;
+
+    LPPROF_START(LPPROF_LPREQ_PACK);
+    len = lpc_encode(&lpreq_cancel_schema, &msg, cancel_buffer, sizeof(cancel_buffer));
+    LPPROF_STOP(LPPROF_LPREQ_PACK);
+
+    if (len < 0) {
+        P_ERR("%s: lpc_encode\n", __func__);
+        return -1;
+    }
+
+    mira_status_t ret =
+        mira_net_udp_send_to(
+            lpreq_udp_connection,
+            dst,
+            dst_port,
+            cancel_buffer,
+            len);
+
+    if (ret != MIRA_SUCCESS) {
+        P_ERR("[%d]: mira_net_udp_send_to\n", ret);
+        return -1;
+    }
+    lpb_charge(len);
     return 0;
 }
 
@@ -116,117 +212,141 @@ void lpreq_handle_data(
     const uint16_t data_len,
     const mira_net_udp_callback_metadata_t *metadata)
 {
-    if (memcmp(data, lpreq_header, sizeof(lpreq_header) != 0)) {
-        /* Not a request packet */
+    if (lpc_match(&lpreq_cancel_schema, data, data_len)) {
+        lpreq_cancel_handle_data(data, data_len, metadata);
         return;
     }
 
-    uint16_t packet_id;
-    uint64_t mask;
-    uint16_t period;
-    if (lpreq_unpack_buffer(&packet_id, &mask, &period, data, data_len) < 0) {
-        P_ERR("%s: lpreq_unpack_buffer\n", __func__);
+    if (lpc_match(&lpreq_batch_schema, data, data_len)) {
+        lpreq_batch_handle_data(data, data_len, metadata);
         return;
     }
 
-    P_DEBUG(
-        "Request received for packet id %d, mask: 0x%08lx%08lx, period: %d ms\n",
-        packet_id,
-        (uint32_t) (mask >> 32),
-        (uint32_t) (mask & UINT32_MAX),
-        period);
-
-    /* Post event with data */
-    static lp_event_requested_data_t lpreq_event_data;
-    lpreq_event_data = (lp_event_requested_data_t) {
-        .packet_id = packet_id,
-        .mask = mask,
-        .period_ms = period,
-        .src_port = metadata->source_port,
-    };
-    memcpy(
-        &lpreq_event_data.src,
-        metadata->source_address,
-        sizeof(mira_net_address_t));
+    const lpc_schema_t *schema;
+    if (lpc_match(&lpreq_session_schema, data, data_len)) {
+        schema = &lpreq_session_schema;
+    } else if (lpc_match(&lpreq_schema, data, data_len)) {
+        schema = &lpreq_schema;
+    } else {
+        /* Not a request packet */
+        return;
+    }
 
-    /* TODO: post to specific processes instead of broadcast? */
-    if (process_post(PROCESS_BROADCAST, event_lp_requested, &lpreq_event_data)
-        != PROCESS_ERR_OK
-    ) {
-        P_ERR("%s: process_post!\n", __func__);
+    lpreq_msg_t msg = { .session = LPREQ_NO_SESSION };
+    LPPROF_START(LPPROF_LPREQ_UNPACK);
+    if (lpc_decode(schema, &msg, data, data_len) < 0) {
+        P_ERR("%s: wrong lp request packet size (%d)!\n", __func__, data_len);
         return;
     }
+    LPPROF_STOP(LPPROF_LPREQ_UNPACK);
+
+    lpreq_requested_post(
+        msg.packet_id,
+        msg.mask,
+        msg.period_ms,
+        msg.session,
+        metadata);
 }
 
 // ******************************************************************************
 // Internal functions
 // ******************************************************************************
+static void lpreq_batch_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata)
+{
+    lpreq_batch_msg_t msg;
+    LPPROF_START(LPPROF_LPREQ_UNPACK);
+    if (lpc_decode(&lpreq_batch_schema, &msg, data, data_len) < 0) {
+        P_ERR("%s: wrong lp batch request packet size (%d)!\n", __func__, data_len);
+        return;
+    }
+    LPPROF_STOP(LPPROF_LPREQ_UNPACK);
+
+    for (int i = 0; i < msg.n_entries; ++i) {
+        lpreq_requested_post(
+            msg.entries[i].packet_id,
+            msg.entries[i].sub_packet_mask,
+            msg.period_ms,
+            LPREQ_NO_SESSION,
+            metadata);
+    }
+}
 
-/* Large packet request format:
- *
- *  +-------------------+----------------------+----------------+------------------+
- *  | header  (16 bits) |  packet_id (16_bits) | mask (64 bits) | period (16 bits) |
- *  +-------------------+----------------------+----------------+------------------+
- *
- * Little endian.
- */
-
-static void lpreq_pack_buffer(
-    uint8_t *buffer,
-    uint16_t packet_id,
-    uint64_t mask,
-    uint16_t period_ms)
+/* Queue event_lp_requested for a requested large packet */
+static void lpreq_requested_post(
+    const uint16_t packet_id,
+    const uint64_t mask,
+    const uint16_t period_ms,
+    const uint8_t session,
+    const mira_net_udp_callback_metadata_t *metadata)
 {
-    memcpy(
-        buffer,
-        lpreq_header,
-        sizeof(lpreq_header));
-    buffer += sizeof(lpreq_header);
+    LPTR_DEBUG(LPTR_EV_REQUEST_RX,
+        packet_id,
+        (uint32_t) (mask & UINT32_MAX),
+        (uint32_t) (mask >> 32));
 
-    LITTLE_ENDIAN_STORE(buffer, packet_id);
-    buffer += sizeof(packet_id);
+    /* Queue event with data */
+    lpd_entry_t *entry = lpd_entry_reserve();
+    if (entry == NULL) {
+        P_ERR("%s: event queue full\n", __func__);
+        return;
+    }
 
-    LITTLE_ENDIAN_STORE(buffer, mask);
-    buffer += sizeof(mask);
+    entry->data.requested = (lp_event_requested_data_t) {
+        .packet_id = packet_id,
+        .mask = mask,
+        .period_ms = period_ms,
+        .session = session,
+        .src_port = metadata->source_port,
+    };
+    memcpy(
+        &entry->data.requested.src,
+        metadata->source_address,
+        sizeof(mira_net_address_t));
 
-    LITTLE_ENDIAN_STORE(buffer, period_ms);
-    buffer += sizeof(period_ms);
+    lpd_entry_commit(
+        entry,
+        event_lp_requested,
+        &entry->data.requested.src,
+        packet_id);
 }
 
-static int lpreq_unpack_buffer(
-    uint16_t *packet_id,
-    uint64_t *mask,
-    uint16_t *period_ms,
-    const uint8_t *buffer,
-    uint8_t len)
+static void lpreq_cancel_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata)
 {
-    if ((packet_id == NULL)
-        || (mask == NULL)
-        || (period_ms == NULL)
-        || (buffer == NULL)
-    ) {
-        P_ERR("%s: pointer error!\n", __func__);
-        return -1;
-    }
-    if (len != sizeof(lpreq_header)
-        + sizeof(*packet_id)
-        + sizeof(*mask)
-        + sizeof(*period_ms)
-    ) {
-        P_ERR("%s: wrong lp request packet size (%d)!\n", __func__, len);
-        return -1;
+    lpreq_cancel_msg_t msg;
+    LPPROF_START(LPPROF_LPREQ_UNPACK);
+    if (lpc_decode(&lpreq_cancel_schema, &msg, data, data_len) < 0) {
+        P_ERR("%s: wrong lp cancel packet size (%d)!\n", __func__, data_len);
+        return;
     }
+    LPPROF_STOP(LPPROF_LPREQ_UNPACK);
 
-    buffer += sizeof(lpreq_header);
+    LPTR_DEBUG(LPTR_EV_CANCEL_RX, msg.packet_id, 0, 0);
 
-    LITTLE_ENDIAN_LOAD(packet_id, buffer);
-    buffer += sizeof(*packet_id);
-
-    LITTLE_ENDIAN_LOAD(mask, buffer);
-    buffer += sizeof(*mask);
+    /* Queue event with data */
+    lpd_entry_t *entry = lpd_entry_reserve();
+    if (entry == NULL) {
+        P_ERR("%s: event queue full\n", __func__);
+        return;
+    }
 
-    LITTLE_ENDIAN_LOAD(period_ms, buffer);
-    buffer += sizeof(*period_ms);
+    entry->data.cancelled = (lp_event_cancelled_data_t) {
+        .packet_id = msg.packet_id,
+        .src_port = metadata->source_port,
+    };
+    memcpy(
+        &entry->data.cancelled.src,
+        metadata->source_address,
+        sizeof(mira_net_address_t));
 
-    return 0;
+    lpd_entry_commit(
+        entry,
+        event_lp_cancelled,
+        &entry->data.cancelled.src,
+        msg.packet_id);
 }
@@ -12,20 +12,42 @@ form without prior written permission from LumenRadio AB.
 #include <stdint.h>
 
 #include "large_packet.h"
+/* lpreq_entry_t and LPREQ_BATCH_MAX_ENTRIES */
+#include "lp_wire.h"
 
 int lpreq_init(
     mira_net_udp_connection_t *udp_connection);
 
-/* Send a request for large packet */
+/* Send a request for large packet. With a session handle other than
+ * LPREQ_NO_SESSION, see lpsp_session_open(), the sender sends compact
+ * sub-packets. */
 int lpreq_send(
     const mira_net_address_t *dst,
     const uint16_t port,
     const uint16_t packet_id,
     const uint64_t sub_packet_mask,
+    const uint16_t sub_packet_period_ms,
+    const uint8_t session);
+
+/* Request the n_entries large packets of entries from dst, in one message, all
+ * at the same sub-packet period. The sender handles each entry as a request of
+ * its own. */
+int lpreq_batch_send(
+    const mira_net_address_t *dst,
+    const uint16_t port,
+    const lpreq_entry_t *entries,
+    const uint8_t n_entries,
     const uint16_t sub_packet_period_ms);
 
+/* Cancel a request for large packet. The sender stops sending its
+ * sub-packets. */
+int lpreq_cancel_send(
+    const mira_net_address_t *dst,
+    const uint16_t port,
+    const uint16_t packet_id);
+
 /* Handle incoming data, if relevant. This function first tests if the data is a
- * valid request message. If it is, it acts by posting an event. */
+ * valid request, batch request or cancel message. If it is, it acts by posting an event. */
 void lpreq_handle_data(
     const void *data,
     const uint16_t data_len,
@@ -0,0 +1,50 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lp_rxrules.h"
+#include "lp_wire.h"
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+uint64_t lprr_whole_mask(
+    uint8_t n_sub_packets)
+{
+    /* Use hard-coded value since it's coupled to the variable type. */
+    if (n_sub_packets >= 64) {
+        return UINT64_MAX;
+    }
+
+    return (((uint64_t) 1) << n_sub_packets) - 1;
+}
+
+bool lprr_signal_valid(
+    uint8_t n_sub_packets)
+{
+    return n_sub_packets > 0
+           && n_sub_packets <= LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS;
+}
+
+bool lprr_sub_packet_valid(
+    uint8_t rx_n_sub_packets,
+    uint8_t n_sub_packets,
+    uint8_t sub_packet_index,
+    uint16_t payload_len)
+{
+    return n_sub_packets == rx_n_sub_packets
+           && sub_packet_index < rx_n_sub_packets
+           && payload_len <= LARGE_PACKET_SUBPACKET_MAX_BYTES;
+}
+
+uint32_t lprr_timeout_ms(
+    uint16_t period_ms,
+    uint32_t random)
+{
+    return (uint32_t) period_ms * LPRR_TIMEOUT_PERIODS
+           + random % ((uint32_t) period_ms + 1);
+}
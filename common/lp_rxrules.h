@@ -0,0 +1,59 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_RXRULES_H
+#define LP_RXRULES_H
+
+/* Function identifier prefix: lprr_ */
+
+/* Rules of the receiving side of the protocol: validation of signals and
+ * sub-packets, time-out on reception, progress reports and requests for
+ * missing sub-packets. Shared by large_packet_receive_proc on a Mira root and
+ * the Linux receiver (see host/lp_rx.h), so it does not depend on Mira. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Max number of times to request re-transmission of missing sub-packets,
+ * before giving up. */
+#define LPRR_MAX_RETRANSMISSION_REQUESTS (4)
+
+/* Receiver reports its progress (acknowledgement) every this number of
+ * received sub-packets, and once the whole large packet is received. */
+#define LPRR_PROGRESS_REPORT_INTERVAL (8)
+
+/* Time-out on sub-packet reception, in sub-packet periods. A random jitter of
+ * up to one period is added, see lprr_timeout_ms(). */
+#define LPRR_TIMEOUT_PERIODS (10)
+
+/* Mask of all sub-packets of a large packet of n_sub_packets sub-packets, at
+ * most LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS. */
+uint64_t lprr_whole_mask(
+    uint8_t n_sub_packets);
+
+/* True if a signaled large packet of n_sub_packets sub-packets can be
+ * received. */
+bool lprr_signal_valid(
+    uint8_t n_sub_packets);
+
+/* True if sub-packet sub_packet_index of a large packet of n_sub_packets, with
+ * payload_len bytes, belongs to the large packet being received, of
+ * rx_n_sub_packets sub-packets. The index selects the bit of the mask and the
+ * offset in the payload. */
+bool lprr_sub_packet_valid(
+    uint8_t rx_n_sub_packets,
+    uint8_t n_sub_packets,
+    uint8_t sub_packet_index,
+    uint16_t payload_len);
+
+/* Time-out on sub-packet reception, in ms, at sub-packet period period_ms.
+ * random is any random number, for the jitter, which spreads the requests of
+ * several receivers of the same multicast large packet. */
+uint32_t lprr_timeout_ms(
+    uint16_t period_ms,
+    uint32_t random);
+
+#endif
@@ -7,43 +7,41 @@ form without prior written permission from LumenRadio AB.
 #include <string.h>
 
 #include "large_packet.h"
+#include "lp_budget.h"
+#include "lp_codec.h"
+#include "lp_dispatch.h"
 #include "lp_events.h"
+#include "lp_prof.h"
 #include "lp_signal.h"
+#include "lp_wire.h"
 
 #define DEBUG_LEVEL 2
 #include "utils.h"
 
+#define LPTR_MODULE LPTR_MODULE_LPSIG
+#include "lp_trace.h"
+
 // ******************************************************************************
 // Global variables
 // ******************************************************************************
 process_event_t event_lp_signaled_ready;
 
-// ******************************************************************************
-// Module constants
-// ******************************************************************************
-static const uint8_t lpsig_header[LP_HEADER_SIZE] = {
-    0x54, 0xab
-};
-
-static mira_net_udp_connection_t *lpsig_udp_connection;
-
 // ******************************************************************************
 // Module variables
 // ******************************************************************************
+static mira_net_udp_connection_t *lpsig_udp_connection;
 
 // ******************************************************************************
 // Function prototypes
 // ******************************************************************************
-static void lpsig_pack_buffer(
-    uint8_t *buffer,
-    uint16_t packet_id,
-    uint8_t n_sub_packets);
+static void lpsig_batch_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata);
 
-static int lpsig_unpack_buffer(
-    uint8_t *n_sub_packets,
-    uint16_t *packet_id,
-    const uint8_t *buffer,
-    uint8_t len);
+static void lpsig_signaled_post(
+    const lpsig_msg_t *signaled,
+    const mira_net_udp_callback_metadata_t *metadata);
 
 // ******************************************************************************
 // Function definitions
@@ -61,23 +59,34 @@ int lpsig_init(
 int lpsig_send(
     const mira_net_address_t *dst,
     uint16_t packet_id,
-    uint8_t n_sub_packets)
+    uint8_t n_sub_packets,
+    uint8_t flags,
+    uint16_t segment)
 {
-    uint8_t packet_ready_message[
-        sizeof(lpsig_header)
-        + sizeof(packet_id)
-        + sizeof(n_sub_packets)
-    ];
-
-#if DEBUG_LEVEL > 0
-    char addr_str_buffer[MIRA_NET_MAX_ADDRESS_STR_LEN];
-#endif
-    P_DEBUG("Sending lp signal to %s: id %d, %d sub-packets\n",
-        mira_net_toolkit_format_address(addr_str_buffer, dst),
-        packet_id,
-        n_sub_packets);
-
-    lpsig_pack_buffer(packet_ready_message, packet_id, n_sub_packets);
+    const lpsig_msg_t msg = {
+        .packet_id = packet_id,
+        .n_sub_packets = n_sub_packets,
+        .flags = flags,
+        .segment = segment,
+    };
+    uint8_t packet_ready_message[LPC_HEADER_SIZE + sizeof(msg)];
+    int len;
+
+    LPTR_DEBUG(LPTR_EV_SIGNAL_TX, packet_id, n_sub_packets, flags);
+
+    LPPROF_START(LPPROF_LPSIG_PACK);
+    /* The plain signal for segment 0, which is also at offset 0 */
+    len = lpc_encode(
+        segment == 0 ? &lpsig_schema : &lpsig_segment_schema,
+        &msg,
+        packet_ready_message,
+        sizeof(packet_ready_message));
+    LPPROF_STOP(LPPROF_LPSIG_PACK);
+
+    if (len < 0) {
+        P_ERR("%s: lpc_encode\n", __func__);
+        return -1;
+    }
 
     mira_status_t ret;
     ret = mira_net_udp_send_to(
@@ -85,12 +94,66 @@ int lpsig_send(
         dst,
         LARGE_PACKET_RX_UDP_PORT,
         packet_ready_message,
-        sizeof(packet_ready_message));
+        len);
+
+    if (ret != MIRA_SUCCESS) {
+        P_ERR("[%d]: mira_net_udp_send_to\n", ret);
+        return -1;
+    }
+    lpb_charge(len);
+
+    return 0;
+}
+
+int lpsig_batch_send(
+    const mira_net_address_t *dst,
+    const lpsig_msg_t *entries,
+    uint8_t n_entries)
+{
+    lpsig_batch_msg_t msg;
+    uint8_t batch_message[LPC_HEADER_SIZE + sizeof(msg)];
+    int len;
+
+    if (n_entries > LPSIG_BATCH_MAX_ENTRIES) {
+        P_ERR("%s: too many entries (%d)\n", __func__, n_entries);
+        return -1;
+    }
+
+    msg.n_entries = n_entries;
+    for (int i = 0; i < n_entries; ++i) {
+        msg.entries[i] = entries[i];
+        LPTR_DEBUG(LPTR_EV_SIGNAL_TX,
+            entries[i].packet_id,
+            entries[i].n_sub_packets,
+            entries[i].flags);
+    }
+
+    LPPROF_START(LPPROF_LPSIG_PACK);
+    len = lpc_encode(
+        &lpsig_batch_schema,
+        &msg,
+        batch_message,
+        sizeof(batch_message));
+    LPPROF_STOP(LPPROF_LPSIG_PACK);
+
+    if (len < 0) {
+        P_ERR("%s: lpc_encode\n", __func__);
+        return -1;
+    }
+
+    mira_status_t ret;
+    ret = mira_net_udp_send_to(
+        lpsig_udp_connection,
+        dst,
+        LARGE_PACKET_RX_UDP_PORT,
+        batch_message,
+        len);
 
     if (ret != MIRA_SUCCESS) {
         P_ERR("[%d]: mira_net_udp_send_to\n", ret);
         return -1;
     }
+    lpb_charge(len);
 
     return 0;
 }
@@ -100,12 +163,18 @@ void lpsig_handle_data(
     const uint16_t data_len,
     const mira_net_udp_callback_metadata_t *metadata)
 {
-    if (data_len < LP_HEADER_SIZE) {
-        P_ERR("%s: packet too short\n", __func__);
+    if (lpc_match(&lpsig_batch_schema, data, data_len)) {
+        lpsig_batch_handle_data(data, data_len, metadata);
         return;
     }
 
-    if (memcmp(data, lpsig_header, sizeof(lpsig_header) != 0)) {
+    const lpc_schema_t *schema;
+
+    if (lpc_match(&lpsig_schema, data, data_len)) {
+        schema = &lpsig_schema;
+    } else if (lpc_match(&lpsig_segment_schema, data, data_len)) {
+        schema = &lpsig_segment_schema;
+    } else {
         /* Not a signal packet */
         return;
     }
@@ -114,94 +183,71 @@ void lpsig_handle_data(
     source (metadata->source_address). Failing to do so results in mixing up two
     messages with the same packet_id but from different sources. */
 
-    uint8_t n_sub_packets;
-    uint16_t packet_id;
-    if (lpsig_unpack_buffer(&n_sub_packets, &packet_id, data, data_len) < 0) {
+    lpsig_msg_t msg = { .segment = 0 };
+    LPPROF_START(LPPROF_LPSIG_UNPACK);
+    if (lpc_decode(schema, &msg, data, data_len) < 0) {
         P_ERR("Invalid notification\n");
         return;
     }
+    LPPROF_STOP(LPPROF_LPSIG_UNPACK);
 
-    P_DEBUG("Signal received for packet id %d with %d sub-packets\n",
-        packet_id,
-        n_sub_packets);
-
-    /* Post event with data */
-    static lp_event_signaled_data_t lpsig_event_data;
-    lpsig_event_data = (lp_event_signaled_data_t) {
-        .n_sub_packets = n_sub_packets,
-        .packet_id = packet_id,
-        .src_port = metadata->source_port,
-    };
-    memcpy(
-        &lpsig_event_data.src,
-        metadata->source_address,
-        sizeof(mira_net_address_t));
-
-    if (process_post(PROCESS_BROADCAST, event_lp_signaled_ready, &lpsig_event_data)
-        != PROCESS_ERR_OK
-    ) {
-        P_ERR("%s: process_post\n", __func__);
-        return;
-    }
+    lpsig_signaled_post(&msg, metadata);
 }
 
 // ******************************************************************************
 // Internal functions
 // ******************************************************************************
-
-/* Large packet signal format:
- *
- *  +-------------------+----------------------+------------------------+
- *  | header  (16 bits) |  packet_id (16_bits) | n_sub_packets (8 bits) |
- *  +-------------------+----------------------+------------------------+
- *
- * Little endian.
- */
-
-static void lpsig_pack_buffer(
-    uint8_t *buffer,
-    uint16_t packet_id,
-    uint8_t n_sub_packets)
+static void lpsig_batch_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata)
 {
-    memcpy(buffer, lpsig_header, sizeof(lpsig_header));
-    buffer += sizeof(lpsig_header);
-
-    LITTLE_ENDIAN_STORE(buffer, packet_id);
-    buffer += sizeof(packet_id);
+    lpsig_batch_msg_t msg;
+    LPPROF_START(LPPROF_LPSIG_UNPACK);
+    if (lpc_decode(&lpsig_batch_schema, &msg, data, data_len) < 0) {
+        P_ERR("Invalid batch notification\n");
+        return;
+    }
+    LPPROF_STOP(LPPROF_LPSIG_UNPACK);
 
-    LITTLE_ENDIAN_STORE(buffer, n_sub_packets);
-    buffer += sizeof(n_sub_packets);
+    for (int i = 0; i < msg.n_entries; ++i) {
+        lpsig_signaled_post(&msg.entries[i], metadata);
+    }
 }
 
-static int lpsig_unpack_buffer(
-    uint8_t *n_sub_packets,
-    uint16_t *packet_id,
-    const uint8_t *buffer,
-    uint8_t len)
+/* Queue event_lp_signaled_ready for a signaled large packet */
+static void lpsig_signaled_post(
+    const lpsig_msg_t *signaled,
+    const mira_net_udp_callback_metadata_t *metadata)
 {
-    if ((n_sub_packets == NULL)
-        || (packet_id == NULL)
-        || (buffer == NULL)
-    ) {
-        P_ERR("%s: pointer error!\n", __func__);
-        return -1;
-    }
-
-    if (len != (sizeof(lpsig_header)
-                + sizeof(*n_sub_packets)
-                + sizeof(*packet_id))
-    ) {
-        P_ERR("%s: wrong lp signal packet size (%d)!\n", __func__, len);
-        return -1;
+    LPTR_DEBUG(LPTR_EV_SIGNAL_RX,
+        signaled->packet_id,
+        signaled->n_sub_packets,
+        signaled->flags);
+
+    /* Queue event with data */
+    lpd_entry_t *entry = lpd_entry_reserve();
+    if (entry == NULL) {
+        P_ERR("%s: event queue full\n", __func__);
+        return;
     }
 
-    buffer += sizeof(lpsig_header);
-
-    LITTLE_ENDIAN_LOAD(packet_id, buffer);
-    buffer += sizeof(*packet_id);
-
-    LITTLE_ENDIAN_LOAD(n_sub_packets, buffer);
-    buffer += sizeof(*n_sub_packets);
+    entry->data.signaled = (lp_event_signaled_data_t) {
+        .n_sub_packets = signaled->n_sub_packets,
+        .packet_id = signaled->packet_id,
+        .push = (signaled->flags & LPSIG_FLAG_PUSH) != 0,
+        .subscribed = (signaled->flags & LPSIG_FLAG_SUBSCRIBED) != 0,
+        .segment = signaled->segment,
+        .src_port = metadata->source_port,
+    };
+    memcpy(
+        &entry->data.signaled.src,
+        metadata->source_address,
+        sizeof(mira_net_address_t));
 
-    return 0;
+    lpd_entry_commit(
+        entry,
+        event_lp_signaled_ready,
+        &entry->data.signaled.src,
+        signaled->packet_id);
 }
@@ -11,20 +11,34 @@ form without prior written permission from LumenRadio AB.
 #include <stdint.h>
 
 #include "large_packet.h"
+/* Signal flags LPSIG_FLAG_*, lpsig_msg_t and LPSIG_BATCH_MAX_ENTRIES */
+#include "lp_wire.h"
 
 /* Initialize the module, with role as Receiver (root) or Sender. See
  * large_packet.h */
 int lpsig_init(
     mira_net_udp_connection_t *udp_connection);
 
-/* Signal to dst that there is a large packet ready for sending */
+/* Signal to dst that there is a large packet ready for sending. flags is a
+ * combination of LPSIG_FLAG_*, or 0. segment is the segment of a larger object
+ * the large packet holds, 0 if none (see LARGE_PACKET_SEGMENT_MAX_BYTES). */
 int lpsig_send(
     const mira_net_address_t *dst,
     uint16_t packet_id,
-    uint8_t n_sub_packets);
+    uint8_t n_sub_packets,
+    uint8_t flags,
+    uint16_t segment);
+
+/* Signal to dst that the n_entries large packets of entries are ready for
+ * sending, in one message, segment included. The receiver handles each entry as
+ * a signal of its own. */
+int lpsig_batch_send(
+    const mira_net_address_t *dst,
+    const lpsig_msg_t *entries,
+    uint8_t n_entries);
 
 /* Handle incoming data, if relevant. This function first tests if the data is a
- * valid signal message. If it is, it acts by posting an event. */
+ * valid signal or batch signal message. If it is, it acts by posting an event. */
 void lpsig_handle_data(
     const void *data,
     const uint16_t data_len,
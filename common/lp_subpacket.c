@@ -8,48 +8,61 @@ form without prior written permission from LumenRadio AB.
 #include <string.h>
 
 #include "large_packet.h"
+#include "lp_budget.h"
+#include "lp_codec.h"
+#include "lp_dispatch.h"
 #include "lp_events.h"
+#include "lp_prof.h"
+#include "lp_rxrules.h"
 #include "lp_subpacket.h"
+#include "lp_wire.h"
 
 #define DEBUG_LEVEL 2
 #include "utils.h"
 
+#define LPTR_MODULE LPTR_MODULE_LPSP
+#include "lp_trace.h"
+
 // ******************************************************************************
 // Global variables
 // ******************************************************************************
 process_event_t event_lp_subpacket_received;
 
 // ******************************************************************************
-// Module constants
+// Module types
 // ******************************************************************************
-static const uint8_t lpsp_header[LP_HEADER_SIZE] = {
-    0x1f, 0xb3
-};
+typedef struct {
+    uint8_t handle; /* LPREQ_NO_SESSION if free */
+    mira_net_address_t src;
+    uint16_t packet_id;
+    uint8_t n_sub_packets;
+} lpsp_session_t;
 
 // ******************************************************************************
 // Module variables
 // ******************************************************************************
 static mira_net_udp_connection_t *lpsp_udp_connection;
 
+static lpsp_session_t lpsp_sessions[LPSP_MAX_SESSIONS];
+/* Handles go round, so that a late sub-packet of a closed session is not taken
+ * for one of the next session in the same slot */
+static uint8_t lpsp_next_handle = LPREQ_NO_SESSION + 1;
+
 // ******************************************************************************
 // Function prototypes
 // ******************************************************************************
-static void lpsp_pack_buffer(
-    uint8_t *buffer,
+static void lpsp_compact_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata);
+
+static void lpsp_received_post(
     uint16_t packet_id,
     uint8_t sub_packet_index,
     uint8_t n_sub_packets,
     const uint8_t *payload,
-    uint16_t payload_len);
-
-static int lpsp_unpack_buffer(
-    uint16_t *packet_id,
-    uint8_t *sub_packet_index,
-    uint8_t *n_sub_packets,
-    uint16_t *payload_len,
-    uint8_t *payload,
-    const uint8_t *buffer,
-    uint16_t buf_len);
+    uint16_t payload_len,
+    const mira_net_udp_callback_metadata_t *metadata);
 
 // ******************************************************************************
 // Function definitions
@@ -61,6 +74,8 @@ int lpsp_init(
 
     event_lp_subpacket_received = process_alloc_event();
 
+    memset(lpsp_sessions, 0, sizeof(lpsp_sessions));
+
     return 0;
 }
 
@@ -68,53 +83,127 @@ int lpsp_send(
     const mira_net_address_t *dst,
     uint16_t dst_port,
     uint16_t packet_id,
+    uint8_t session,
     uint8_t sub_packet_index,
     uint8_t n_sub_packets,
     const uint8_t *data,
     const uint16_t data_len)
 {
-    uint8_t sub_packet_frame[
-        sizeof(lpsp_header)
-        + sizeof(packet_id)
-        + sizeof(sub_packet_index)
-        + sizeof(n_sub_packets)
-        + sizeof(data_len)
-        + data_len
-    ];
-
-    lpsp_pack_buffer(
-        sub_packet_frame,
-        packet_id,
-        sub_packet_index,
-        n_sub_packets,
-        data,
-        data_len);
+    const lpsp_msg_t msg = {
+        .packet_id = packet_id,
+        .sub_packet_index = sub_packet_index,
+        .n_sub_packets = n_sub_packets,
+        .payload_len = data_len,
+        .payload = data,
+    };
+    const lpsp_compact_msg_t compact_msg = {
+        .session = session,
+        .sub_packet_index = sub_packet_index,
+        .payload_len = data_len,
+        .payload = data,
+    };
+    uint8_t sub_packet_frame[lpc_encoded_size(&lpsp_schema, &msg)];
+    int len;
+
+    LPPROF_START(LPPROF_LPSP_PACK);
+    if (session != LPREQ_NO_SESSION) {
+        len = lpc_encode(
+            &lpsp_compact_schema,
+            &compact_msg,
+            sub_packet_frame,
+            sizeof(sub_packet_frame));
+    } else {
+        len = lpc_encode(&lpsp_schema, &msg, sub_packet_frame, sizeof(sub_packet_frame));
+    }
+    LPPROF_STOP(LPPROF_LPSP_PACK);
+
+    if (len < 0) {
+        P_ERR("%s: payload too large (%d)\n", __func__, data_len);
+        return -1;
+    }
 
     mira_status_t ret = mira_net_udp_send_to(
         lpsp_udp_connection,
         dst,
         dst_port,
         sub_packet_frame,
-        sizeof(sub_packet_frame));
+        len);
 
+    if (ret == MIRA_ERROR_NO_MEMORY) {
+        LPTR_DEBUG(LPTR_EV_TX_QUEUE_FULL, packet_id, sub_packet_index, 0);
+        return LPSP_ERROR_QUEUE_FULL;
+    }
     if (ret != MIRA_SUCCESS) {
         P_ERR("%s: could not send on UDP\n", __func__);
         return -1;
     }
+    lpb_charge(len);
+    LPTR_DEBUG(LPTR_EV_SUBPACKET_TX, packet_id, sub_packet_index, data_len);
     return 0;
 }
 
+uint16_t lpsp_datagram_size(
+    uint16_t payload_len)
+{
+    const lpsp_msg_t msg = {
+        .payload_len = payload_len,
+    };
+
+    return lpc_encoded_size(&lpsp_schema, &msg);
+}
+
+uint8_t lpsp_session_open(
+    const mira_net_address_t *src,
+    uint16_t packet_id,
+    uint8_t n_sub_packets)
+{
+    for (int i = 0; i < LPSP_MAX_SESSIONS; ++i) {
+        lpsp_session_t *session = &lpsp_sessions[i];
+
+        if (session->handle != LPREQ_NO_SESSION) {
+            continue;
+        }
+
+        *session = (lpsp_session_t) {
+            .handle = lpsp_next_handle,
+            .src = *src,
+            .packet_id = packet_id,
+            .n_sub_packets = n_sub_packets,
+        };
+        if (++lpsp_next_handle == LPREQ_NO_SESSION) {
+            lpsp_next_handle++;
+        }
+        return session->handle;
+    }
+
+    return LPREQ_NO_SESSION;
+}
+
+void lpsp_session_close(
+    uint8_t session)
+{
+    if (session == LPREQ_NO_SESSION) {
+        return;
+    }
+
+    for (int i = 0; i < LPSP_MAX_SESSIONS; ++i) {
+        if (lpsp_sessions[i].handle == session) {
+            lpsp_sessions[i].handle = LPREQ_NO_SESSION;
+        }
+    }
+}
+
 void lpsp_handle_data(
     const void *data,
     const uint16_t data_len,
     const mira_net_udp_callback_metadata_t *metadata)
 {
-    if (data_len < LP_HEADER_SIZE) {
-        P_ERR("%s: packet too short\n", __func__);
+    if (lpc_match(&lpsp_compact_schema, data, data_len)) {
+        lpsp_compact_handle_data(data, data_len, metadata);
         return;
     }
 
-    if (memcmp(data, lpsp_header, sizeof(lpsp_header) != 0)) {
+    if (!lpc_match(&lpsp_schema, data, data_len)) {
         /* Not a sub-packet */
         return;
     }
@@ -123,147 +212,116 @@ void lpsp_handle_data(
     source (metadata->source_address). Failing to do so results in mixing up two
     messages with the same packet_id but from different sources. */
 
-    uint16_t packet_id;
-    uint8_t sub_packet_index;
-    uint8_t n_sub_packets;
-    static uint8_t payload[LARGE_PACKET_SUBPACKET_MAX_BYTES];
-    uint16_t payload_len;
-
-    if (lpsp_unpack_buffer(
-        &packet_id,
-        &sub_packet_index,
-        &n_sub_packets,
-        &payload_len,
-        payload,
-        data,
-        data_len) < 0
-    ) {
-        P_ERR("%s: invalid sub-packet\n", __func__);
-        return;
-    }
-
-    /* Post event with data */
-    static lp_event_subpacket_data_t lpsp_event_data;
-    lpsp_event_data = (lp_event_subpacket_data_t) {
-        .packet_id = packet_id,
-        .sub_packet_index = sub_packet_index,
-        .n_sub_packets = n_sub_packets,
-        .payload_len = payload_len,
-        .payload = payload,
-        .src_port = metadata->source_port,
-    };
-    memcpy(
-        &lpsp_event_data.src,
-        metadata->source_address,
-        sizeof(mira_net_address_t));
-
-    if (process_post(
-        PROCESS_BROADCAST,
-        event_lp_subpacket_received,
-        &lpsp_event_data)
-        != PROCESS_ERR_OK
-    ) {
-        P_ERR("%s: process_post\n", __func__);
+    lpsp_msg_t msg;
+    LPPROF_START(LPPROF_LPSP_UNPACK);
+    if (lpc_decode(&lpsp_schema, &msg, data, data_len) < 0) {
+        P_ERR("%s: invalid sub-packet (%d bytes)\n", __func__, data_len);
         return;
     }
+    LPPROF_STOP(LPPROF_LPSP_UNPACK);
+
+    lpsp_received_post(
+        msg.packet_id,
+        msg.sub_packet_index,
+        msg.n_sub_packets,
+        msg.payload,
+        msg.payload_len,
+        metadata);
 }
 
 // ******************************************************************************
 // Internal functions
 // ******************************************************************************
+static void lpsp_compact_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata)
+{
+    lpsp_compact_msg_t msg;
+    LPPROF_START(LPPROF_LPSP_UNPACK);
+    if (lpc_decode(&lpsp_compact_schema, &msg, data, data_len) < 0) {
+        P_ERR("%s: invalid sub-packet (%d bytes)\n", __func__, data_len);
+        return;
+    }
+    LPPROF_STOP(LPPROF_LPSP_UNPACK);
+
+    /* The session stands for the large packet and its sender */
+    for (int i = 0; i < LPSP_MAX_SESSIONS; ++i) {
+        const lpsp_session_t *session = &lpsp_sessions[i];
+
+        if (session->handle == msg.session
+            && msg.session != LPREQ_NO_SESSION
+            && memcmp(&session->src, metadata->source_address,
+                sizeof(mira_net_address_t)) == 0
+        ) {
+            lpsp_received_post(
+                session->packet_id,
+                msg.sub_packet_index,
+                session->n_sub_packets,
+                msg.payload,
+                msg.payload_len,
+                metadata);
+            return;
+        }
+    }
+
+    /* Late, the session is closed */
+    LPTR_DEBUG(LPTR_EV_SUBPACKET_DROP, msg.session, msg.sub_packet_index, 0);
+}
 
-/* Sub-packet format:
- *
- *  +-------------------+----------------------+---------------------------+
- *  | header  (16 bits) |  packet_id (16_bits) | sub_packet_index (8 bits) | ...
- *  +-------------------+----------------------+------------------------+--+
- *
- *  +----------------------+----------------------+-----------------------------+
- *  n_sub_packets (8 bits) | payload_len (8 bits) | payload (payload_len bytes) |
- *  +----------------------+----------------------+-----------------------------+
- *
- * Little endian.
- */
-
-static void lpsp_pack_buffer(
-    uint8_t *buffer,
+/* Queue event_lp_subpacket_received for a received sub-packet */
+static void lpsp_received_post(
     uint16_t packet_id,
     uint8_t sub_packet_index,
     uint8_t n_sub_packets,
     const uint8_t *payload,
-    uint16_t payload_len)
-{
-    memcpy(buffer, &lpsp_header, sizeof(lpsp_header));
-    buffer += sizeof(lpsp_header);
-
-    LITTLE_ENDIAN_STORE(buffer, packet_id);
-    buffer += sizeof(packet_id);
-
-    LITTLE_ENDIAN_STORE(buffer, sub_packet_index);
-    buffer += sizeof(sub_packet_index);
-
-    LITTLE_ENDIAN_STORE(buffer, n_sub_packets);
-    buffer += sizeof(n_sub_packets);
-
-    LITTLE_ENDIAN_STORE(buffer, payload_len);
-    buffer += sizeof(payload_len);
-
-    memcpy(buffer, payload, payload_len);
-    buffer += payload_len;
-}
-
-static int lpsp_unpack_buffer(
-    uint16_t *packet_id,
-    uint8_t *sub_packet_index,
-    uint8_t *n_sub_packets,
-    uint16_t *payload_len,
-    uint8_t *payload,
-    const uint8_t *buffer,
-    uint16_t buf_len)
+    uint16_t payload_len,
+    const mira_net_udp_callback_metadata_t *metadata)
 {
-    if ((packet_id == NULL)
-        || (sub_packet_index == NULL)
-        || (n_sub_packets == NULL)
-        || (payload_len == NULL)
-        || (payload == NULL)
-        || (buffer == NULL)
+    LPTR_DEBUG(LPTR_EV_SUBPACKET_RX, packet_id, sub_packet_index, payload_len);
+
+    /* The index selects the bit of the mask, and the offset in the payload */
+    if (!lprr_signal_valid(n_sub_packets)
+        || !lprr_sub_packet_valid(
+            n_sub_packets,
+            n_sub_packets,
+            sub_packet_index,
+            payload_len)
     ) {
-        P_ERR("%s: pointer error!\n", __func__);
-        return -1;
+        P_ERR("%s: invalid sub-packet %d of %d\n",
+            __func__,
+            sub_packet_index,
+            n_sub_packets);
+        LPTR_DEBUG(LPTR_EV_SUBPACKET_DROP, packet_id, sub_packet_index, 0);
+        return;
     }
 
-    /* Discard header, which the caller must check before unpacking. */
-    buffer += sizeof(lpsp_header);
-
-    LITTLE_ENDIAN_LOAD(packet_id, buffer);
-    buffer += sizeof(*packet_id);
-
-    LITTLE_ENDIAN_LOAD(sub_packet_index, buffer);
-    buffer += sizeof(*sub_packet_index);
-
-    LITTLE_ENDIAN_LOAD(n_sub_packets, buffer);
-    buffer += sizeof(*n_sub_packets);
-
-    LITTLE_ENDIAN_LOAD(payload_len, buffer);
-    buffer += sizeof(*payload_len);
-
-    if (buf_len != sizeof(lpsp_header)
-        + sizeof(*packet_id)
-        + sizeof(*sub_packet_index)
-        + sizeof(*n_sub_packets)
-        + sizeof(*payload_len)
-        + *payload_len
-    ) {
-        P_ERR(
-            "%s: wrong sub-packet size (%d). Payload size: %d\n",
-            __func__,
-            buf_len,
-            *payload_len);
-        return -1;
+    /* Queue event with data. The payload is copied into the queue entry, since
+     * the UDP buffer is not kept after this callback. */
+    lpd_entry_t *entry = lpd_entry_reserve();
+    if (entry == NULL) {
+        P_ERR("%s: event queue full\n", __func__);
+        return;
     }
 
-    memcpy(payload, buffer, *payload_len);
-    buffer += *payload_len;
+    memcpy(entry->payload, payload, payload_len);
 
-    return 0;
+    entry->data.subpacket = (lp_event_subpacket_data_t) {
+        .packet_id = packet_id,
+        .sub_packet_index = sub_packet_index,
+        .n_sub_packets = n_sub_packets,
+        .payload_len = payload_len,
+        .payload = entry->payload,
+        .src_port = metadata->source_port,
+    };
+    memcpy(
+        &entry->data.subpacket.src,
+        metadata->source_address,
+        sizeof(mira_net_address_t));
+
+    lpd_entry_commit(
+        entry,
+        event_lp_subpacket_received,
+        &entry->data.subpacket.src,
+        packet_id);
 }
@@ -14,18 +14,50 @@ form without prior written permission from LumenRadio AB.
 int lpsp_init(
     mira_net_udp_connection_t *udp_connection);
 
-/* Send sub-packet to dst */
+/* Returned by lpsp_send() when the TX queue of the stack is full. Transient,
+ * the sub-packet can be sent again later. */
+#define LPSP_ERROR_QUEUE_FULL (-2)
+
+/* Max number of receptions at once with a session handle, see
+ * lpsp_session_open() */
+#ifndef LPSP_MAX_SESSIONS
+#define LPSP_MAX_SESSIONS (2)
+#endif
+
+/* Send sub-packet to dst. With a session handle other than LPREQ_NO_SESSION,
+ * from the request, the compact sub-packet carries the handle in place of
+ * packet_id, n_sub_packets and the payload length. Returns 0 on success,
+ * LPSP_ERROR_QUEUE_FULL or -1. */
 int lpsp_send(
     const mira_net_address_t *dst,
     uint16_t dst_port,
     uint16_t packt_id,
+    uint8_t session,
     uint8_t sub_packet_index,
     uint8_t n_sub_packets,
     const uint8_t *data,
     const uint16_t data_len);
 
+/* Size of the UDP payload of a sub-packet with payload_len bytes of data, at
+ * most: compact sub-packets are smaller */
+uint16_t lpsp_datagram_size(
+    uint16_t payload_len);
+
+/* Open a session for the compact sub-packets of large packet packet_id from
+ * src, to be requested with the returned handle. Returns LPREQ_NO_SESSION if
+ * LPSP_MAX_SESSIONS are open, then the sub-packets come whole. */
+uint8_t lpsp_session_open(
+    const mira_net_address_t *src,
+    uint16_t packet_id,
+    uint8_t n_sub_packets);
+
+/* Close a session, once the reception ends. Its late compact sub-packets are
+ * dropped. */
+void lpsp_session_close(
+    uint8_t session);
+
 /* Handle incoming data, if relevant. This function first tests if the data is a
- * valid sub-packet message. If it is, it acts by posting an event. */
+ * valid sub-packet message, whole or compact. If it is, it acts by posting an event. */
 void lpsp_handle_data(
     const void *data,
     const uint16_t data_len,
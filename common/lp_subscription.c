@@ -0,0 +1,129 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <mira.h>
+#include <string.h>
+
+#include "large_packet.h"
+#include "lp_budget.h"
+#include "lp_codec.h"
+#include "lp_dispatch.h"
+#include "lp_events.h"
+#include "lp_subscription.h"
+#include "lp_wire.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+#define LPTR_MODULE LPTR_MODULE_LPSUB
+#include "lp_trace.h"
+
+// ******************************************************************************
+// Global variables
+// ******************************************************************************
+process_event_t event_lp_subscribed;
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static mira_net_udp_connection_t *lpsub_udp_connection;
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int lpsub_init(
+    mira_net_udp_connection_t *udp_connection)
+{
+    event_lp_subscribed = process_alloc_event();
+
+    lpsub_udp_connection = udp_connection;
+
+    return 0;
+}
+
+int lpsub_send(
+    const mira_net_address_t *dst,
+    const uint16_t dst_port,
+    const uint16_t sub_packet_period_ms,
+    const uint16_t lifetime_s)
+{
+    LPTR_DEBUG(LPTR_EV_SUBSCRIBE_TX, 0, sub_packet_period_ms, lifetime_s);
+
+    const lpsub_msg_t msg = {
+        .period_ms = sub_packet_period_ms,
+        .lifetime_s = lifetime_s,
+    };
+    uint8_t subscription_buffer[LPC_HEADER_SIZE + sizeof(msg)];
+    int len;
+
+    len = lpc_encode(
+        &lpsub_schema,
+        &msg,
+        subscription_buffer,
+        sizeof(subscription_buffer));
+
+    if (len < 0) {
+        P_ERR("%s: lpc_encode\n", __func__);
+        return -1;
+    }
+
+    mira_status_t ret =
+        mira_net_udp_send_to(
+            lpsub_udp_connection,
+            dst,
+            dst_port,
+            subscription_buffer,
+            len);
+
+    if (ret != MIRA_SUCCESS) {
+        P_ERR("[%d]: mira_net_udp_send_to\n", ret);
+        return -1;
+    }
+    lpb_charge(len);
+    return 0;
+}
+
+void lpsub_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata)
+{
+    if (!lpc_match(&lpsub_schema, data, data_len)) {
+        /* Not a subscription packet */
+        return;
+    }
+
+    lpsub_msg_t msg;
+    if (lpc_decode(&lpsub_schema, &msg, data, data_len) < 0) {
+        P_ERR("%s: wrong lp subscription packet size (%d)!\n", __func__, data_len);
+        return;
+    }
+
+    LPTR_DEBUG(LPTR_EV_SUBSCRIBE_RX, 0, msg.period_ms, msg.lifetime_s);
+
+    /* Queue event with data */
+    lpd_entry_t *entry = lpd_entry_reserve();
+    if (entry == NULL) {
+        P_ERR("%s: event queue full\n", __func__);
+        return;
+    }
+
+    entry->data.subscribed = (lp_event_subscribed_data_t) {
+        .period_ms = msg.period_ms,
+        .lifetime_s = msg.lifetime_s,
+        .src_port = metadata->source_port,
+    };
+    memcpy(
+        &entry->data.subscribed.src,
+        metadata->source_address,
+        sizeof(mira_net_address_t));
+
+    /* Not about a particular large packet */
+    lpd_entry_commit(
+        entry,
+        event_lp_subscribed,
+        &entry->data.subscribed.src,
+        0);
+}
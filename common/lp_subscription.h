@@ -0,0 +1,37 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_SUBSCRIPTION_H
+#define LP_SUBSCRIPTION_H
+
+/* Function identifier prefix: lpsub_ */
+
+#include <stdint.h>
+
+#include "large_packet.h"
+
+int lpsub_init(
+    mira_net_udp_connection_t *udp_connection);
+
+/* Subscribe to the large packets of dst, for lifetime_s seconds: dst pushes
+ * each new large packet with large_packet_push_subscribed(), at sub-packet
+ * period sub_packet_period_ms, instead of signaling it. Only missing
+ * sub-packets are requested. Subscribing again renews the subscription. A
+ * lifetime of 0 ends it. */
+int lpsub_send(
+    const mira_net_address_t *dst,
+    const uint16_t port,
+    const uint16_t sub_packet_period_ms,
+    const uint16_t lifetime_s);
+
+/* Handle incoming data, if relevant. This function first tests if the data is a
+ * valid subscription message. If it is, it acts by posting an event. */
+void lpsub_handle_data(
+    const void *data,
+    const uint16_t data_len,
+    const mira_net_udp_callback_metadata_t *metadata);
+
+#endif
@@ -0,0 +1,285 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <mira.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lp_timer.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+// ******************************************************************************
+// Global variables
+// ******************************************************************************
+process_event_t event_lp_timer;
+
+// ******************************************************************************
+// Module constants
+// ******************************************************************************
+#if (LPT_WHEEL_SLOTS & (LPT_WHEEL_SLOTS - 1)) != 0
+#error "LPT_WHEEL_SLOTS must be a power of two"
+#endif
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+/* Each slot is a circular list, with the slot itself as head */
+static lpt_link_t lpt_wheel[LPT_WHEEL_SLOTS];
+static uint16_t lpt_current_slot;
+static uint16_t lpt_n_pending;
+/* Time of the current slot. The wheel only moves when the etimer expires, so
+ * it lags behind the clock in between. */
+static clock_time_t lpt_current_time;
+/* Time of the slot the etimer is armed for, if armed */
+static clock_time_t lpt_armed_time;
+static bool lpt_armed;
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+PROCESS(lpt_proc, "Large packet timer wheel");
+
+static void lpt_insert(
+    lpt_timer_t *timer,
+    clock_time_t interval);
+
+static void lpt_unlink(
+    lpt_timer_t *timer);
+
+static uint16_t lpt_next_slot_distance(
+    void);
+
+static void lpt_wheel_advance(
+    void);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int lpt_init(
+    void)
+{
+    process_exit(&lpt_proc);
+
+    for (int i = 0; i < LPT_WHEEL_SLOTS; ++i) {
+        lpt_wheel[i].next = &lpt_wheel[i];
+        lpt_wheel[i].prev = &lpt_wheel[i];
+    }
+    lpt_current_slot = 0;
+    lpt_n_pending = 0;
+    lpt_current_time = clock_time();
+    lpt_armed = false;
+
+    event_lp_timer = process_alloc_event();
+
+    process_start(&lpt_proc, NULL);
+
+    return 0;
+}
+
+void lpt_set(
+    lpt_timer_t *timer,
+    clock_time_t interval)
+{
+    lpt_stop(timer);
+
+    timer->callback = NULL;
+    timer->p = PROCESS_CURRENT();
+
+    lpt_insert(timer, interval);
+}
+
+void lpt_set_callback(
+    lpt_timer_t *timer,
+    clock_time_t interval,
+    void (*callback)(lpt_timer_t *timer),
+    void *ptr)
+{
+    lpt_stop(timer);
+
+    timer->callback = callback;
+    timer->p = NULL;
+    timer->ptr = ptr;
+
+    lpt_insert(timer, interval);
+}
+
+void lpt_stop(
+    lpt_timer_t *timer)
+{
+    if (!lpt_expired(timer)) {
+        lpt_unlink(timer);
+    }
+}
+
+bool lpt_expired(
+    const lpt_timer_t *timer)
+{
+    return timer->link.next == NULL;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+PROCESS_THREAD(lpt_proc, ev, data)
+{
+    static struct etimer tick_timer;
+
+    PROCESS_BEGIN();
+
+    while (1) {
+        /* Expiry of the etimer, or poll from lpt_insert() for an earlier
+         * slot than the armed one */
+        PROCESS_WAIT_EVENT_UNTIL(
+            ev == PROCESS_EVENT_POLL
+            || etimer_expired(&tick_timer));
+
+        /* Fire the due slots, possibly several if the etimer was late */
+        uint16_t distance;
+        while ((distance = lpt_next_slot_distance()) > 0
+               && clock_time() - lpt_current_time
+               >= (clock_time_t) distance * LPT_TICK
+        ) {
+            lpt_wheel_advance();
+        }
+
+        /* Sleep until the next non-empty slot, or until a timer is set */
+        if (distance > 0) {
+            lpt_armed_time = lpt_current_time
+                + (clock_time_t) distance * LPT_TICK;
+            lpt_armed = true;
+            etimer_set(&tick_timer, lpt_armed_time - clock_time());
+        } else {
+            lpt_armed = false;
+            etimer_stop(&tick_timer);
+        }
+    }
+
+    PROCESS_END();
+}
+
+static void lpt_insert(
+    lpt_timer_t *timer,
+    clock_time_t interval)
+{
+    if (lpt_n_pending == 0) {
+        /* Idle wheel, restart it from now */
+        lpt_current_time = clock_time();
+    }
+
+    /* From the time of the current slot, which may lag behind the clock, so
+     * that the timer does not expire early */
+    uint32_t ticks = (interval + (clock_time() - lpt_current_time)
+                      + LPT_TICK - 1) / LPT_TICK;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+
+    /* The slot is visited every LPT_WHEEL_SLOTS ticks, the first time after
+     * ticks % LPT_WHEEL_SLOTS ticks (or a full turn). */
+    lpt_link_t *slot =
+        &lpt_wheel[(lpt_current_slot + ticks) & (LPT_WHEEL_SLOTS - 1)];
+    timer->rounds = (ticks - 1) / LPT_WHEEL_SLOTS;
+
+    timer->link.next = slot;
+    timer->link.prev = slot->prev;
+    slot->prev->next = &timer->link;
+    slot->prev = &timer->link;
+
+    lpt_n_pending++;
+
+    clock_time_t expiry = lpt_current_time + (clock_time_t) ticks * LPT_TICK;
+    if (!lpt_armed || (int32_t) (expiry - lpt_armed_time) < 0) {
+        /* Have the etimer armed for this slot */
+        process_poll(&lpt_proc);
+    }
+}
+
+static void lpt_unlink(
+    lpt_timer_t *timer)
+{
+    timer->link.prev->next = timer->link.next;
+    timer->link.next->prev = timer->link.prev;
+    timer->link.next = NULL;
+    timer->link.prev = NULL;
+
+    lpt_n_pending--;
+}
+
+/* Number of slots to the next non-empty one, a full turn if only the current
+ * slot holds timers, 0 if no timer is pending */
+static uint16_t lpt_next_slot_distance(
+    void)
+{
+    if (lpt_n_pending == 0) {
+        return 0;
+    }
+
+    for (uint16_t distance = 1; distance < LPT_WHEEL_SLOTS; ++distance) {
+        lpt_link_t *slot = &lpt_wheel[
+            (lpt_current_slot + distance) & (LPT_WHEEL_SLOTS - 1)];
+
+        if (slot->next != slot) {
+            return distance;
+        }
+    }
+    return LPT_WHEEL_SLOTS;
+}
+
+static void lpt_wheel_advance(
+    void)
+{
+    /* Skip empty slots in one step. Timers of later turns are visited once per
+     * turn, to count their rounds down. */
+    uint16_t distance = lpt_next_slot_distance();
+
+    lpt_current_slot = (lpt_current_slot + distance) & (LPT_WHEEL_SLOTS - 1);
+    lpt_current_time += (clock_time_t) distance * LPT_TICK;
+
+    lpt_link_t *slot = &lpt_wheel[lpt_current_slot];
+    lpt_link_t *link = slot->next;
+
+    /* Move due timers out of the slot first, so that timers set again from
+     * callbacks wait for their next turn. Due timers stay pending until fired,
+     * and can be stopped meanwhile. */
+    lpt_link_t due = {
+        .next = &due,
+        .prev = &due,
+    };
+
+    while (link != slot) {
+        lpt_timer_t *timer = (lpt_timer_t *) link;
+        link = link->next;
+
+        if (timer->rounds > 0) {
+            timer->rounds--;
+            continue;
+        }
+
+        timer->link.prev->next = timer->link.next;
+        timer->link.next->prev = timer->link.prev;
+        timer->link.next = &due;
+        timer->link.prev = due.prev;
+        due.prev->next = &timer->link;
+        due.prev = &timer->link;
+    }
+
+    while (due.next != &due) {
+        lpt_timer_t *timer = (lpt_timer_t *) due.next;
+
+        lpt_unlink(timer);
+
+        if (timer->callback != NULL) {
+            timer->callback(timer);
+        } else if (process_is_running(timer->p)) {
+            if (process_post(timer->p, event_lp_timer, timer)
+                != PROCESS_ERR_OK
+            ) {
+                P_ERR("%s: process_post\n", __func__);
+            }
+        }
+    }
+}
@@ -0,0 +1,76 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_TIMER_H
+#define LP_TIMER_H
+
+/* Function identifier prefix: lpt_ */
+
+/* Timer wheel, for the time-outs and pacing of all large packet sessions. A
+ * single etimer drives the wheel, armed for the next non-empty slot: empty
+ * slots are skipped, so that the node wakes on expiries, and once per wheel
+ * turn for timers of later turns, not on every tick. Setting and stopping a
+ * timer take constant time. */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of slots in the wheel. Must be a power of two. */
+#ifndef LPT_WHEEL_SLOTS
+#define LPT_WHEEL_SLOTS (32)
+#endif
+
+/* Wheel resolution, in clock ticks. Timers expire on a multiple of it, never
+ * early. */
+#ifndef LPT_TICK
+#define LPT_TICK (CLOCK_SECOND / 32)
+#endif
+
+/* Event: a timer owned by the process expired. Data: the lpt_timer_t */
+extern process_event_t event_lp_timer;
+
+typedef struct lpt_link {
+    struct lpt_link *next;
+    struct lpt_link *prev;
+} lpt_link_t;
+
+typedef struct lpt_timer {
+    lpt_link_t link; /* first, in wheel slot while pending */
+    uint16_t rounds; /* wheel turns left before expiry */
+    /* On expiry, callback is called if set, otherwise event_lp_timer is posted
+     * to process p. */
+    void (*callback)(struct lpt_timer *timer);
+    struct process *p;
+    void *ptr; /* for the owner's use */
+} lpt_timer_t;
+
+int lpt_init(
+    void);
+
+/* Set timer to expire after interval clock ticks, and post event_lp_timer to
+ * the current process. Restarts the timer if pending. */
+void lpt_set(
+    lpt_timer_t *timer,
+    clock_time_t interval);
+
+/* Set timer to expire after interval clock ticks, and call callback from
+ * process context. Restarts the timer if pending. */
+void lpt_set_callback(
+    lpt_timer_t *timer,
+    clock_time_t interval,
+    void (*callback)(lpt_timer_t *timer),
+    void *ptr);
+
+/* Stop timer, if pending. */
+void lpt_stop(
+    lpt_timer_t *timer);
+
+/* True if the timer is not pending, i.e. expired, stopped or never set. */
+bool lpt_expired(
+    const lpt_timer_t *timer);
+
+#endif
@@ -0,0 +1,182 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <mira.h>
+#include <stdint.h>
+
+#include "lp_frame.h"
+#include "lp_trace.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+// ******************************************************************************
+// Global variables
+// ******************************************************************************
+uint8_t lptr_levels[LPTR_MODULE_COUNT];
+
+// ******************************************************************************
+// Module types
+// ******************************************************************************
+typedef struct {
+    uint32_t time;
+    uint8_t module;
+    uint8_t event;
+    uint16_t arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+} lptr_record_t;
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static lptr_record_t lptr_ring[LPTR_RING_SIZE];
+
+/* Free running, the number of records is head - tail. head is only written by
+ * lptr_record(), tail only by lptr_read(). Each side fences, with release
+ * before publishing its counter and acquire after reading the other's. The
+ * targets are single core, so compiler fences suffice. */
+static volatile uint16_t lptr_head;
+static volatile uint16_t lptr_tail;
+static volatile uint16_t lptr_n_lost;
+
+static lpfr_write_fn_t lptr_write;
+static void *lptr_write_ctx;
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+PROCESS(lptr_proc, "Trace drain");
+
+static void lptr_record_store(
+    uint8_t *buffer,
+    const lptr_record_t *record);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+void lptr_init(
+    lpfr_write_fn_t write,
+    void *ctx)
+{
+    for (int i = 0; i < LPTR_MODULE_COUNT; ++i) {
+        lptr_levels[i] = LP_TRACE_DEFAULT_LEVEL;
+    }
+    lptr_head = 0;
+    lptr_tail = 0;
+    lptr_n_lost = 0;
+    lptr_write = write;
+    lptr_write_ctx = ctx;
+
+    if (lptr_write != NULL) {
+        process_start(&lptr_proc, NULL);
+    }
+}
+
+void lptr_level_set(
+    lptr_module_t module,
+    lptr_level_t level)
+{
+    if (module < LPTR_MODULE_COUNT) {
+        lptr_levels[module] = level;
+    }
+}
+
+void lptr_record(
+    uint8_t module,
+    uint8_t event,
+    uint16_t arg0,
+    uint32_t arg1,
+    uint32_t arg2)
+{
+    if ((uint16_t) (lptr_head - lptr_tail) == LPTR_RING_SIZE) {
+        /* Full: the drain owns the tail, drop the new record */
+        lptr_n_lost++;
+        return;
+    }
+    /* The drain is done with the record before it is overwritten */
+    __atomic_signal_fence(__ATOMIC_ACQUIRE);
+
+    lptr_ring[lptr_head & (LPTR_RING_SIZE - 1)] = (lptr_record_t) {
+        .time = clock_time(),
+        .module = module,
+        .event = event,
+        .arg0 = arg0,
+        .arg1 = arg1,
+        .arg2 = arg2,
+    };
+    /* Record content must be in place before it becomes visible */
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    lptr_head++;
+
+    if (lptr_write != NULL) {
+        process_poll(&lptr_proc);
+    }
+}
+
+int lptr_read(
+    uint8_t *buffer,
+    int max_records)
+{
+    int n = 0;
+
+    while (n < max_records && lptr_tail != lptr_head) {
+        __atomic_signal_fence(__ATOMIC_ACQUIRE);
+        lptr_record_store(
+            buffer + n * LPTR_RECORD_SIZE,
+            &lptr_ring[lptr_tail & (LPTR_RING_SIZE - 1)]);
+        __atomic_signal_fence(__ATOMIC_RELEASE);
+        lptr_tail++;
+        n++;
+    }
+    return n;
+}
+
+PROCESS_THREAD(lptr_proc, ev, data)
+{
+    static uint8_t records[LPTR_RECORDS_PER_FRAME * LPTR_RECORD_SIZE];
+    static lpfr_encoder_t enc;
+
+    PROCESS_BEGIN();
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+        /* Drain by frames of up to LPTR_RECORDS_PER_FRAME records. Records
+         * written meanwhile poll the process again. */
+        int n;
+        while ((n = lptr_read(records, LPTR_RECORDS_PER_FRAME)) > 0) {
+            uint8_t header[LPTR_FRAME_HEADER_SIZE] = {
+                LPFR_TYPE_TRACE,
+                CLOCK_SECOND & 0xff,
+                CLOCK_SECOND >> 8,
+                lptr_n_lost & 0xff,
+                lptr_n_lost >> 8,
+            };
+
+            lpfr_encode_begin(&enc, lptr_write, lptr_write_ctx);
+            lpfr_encode_bytes(&enc, header, sizeof(header));
+            lpfr_encode_bytes(&enc, records, n * LPTR_RECORD_SIZE);
+            lpfr_encode_end(&enc);
+        }
+    }
+
+    PROCESS_END();
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static void lptr_record_store(
+    uint8_t *buffer,
+    const lptr_record_t *record)
+{
+    LITTLE_ENDIAN_STORE(buffer, record->time);
+    buffer[4] = record->module;
+    buffer[5] = record->event;
+    LITTLE_ENDIAN_STORE((buffer + 6), record->arg0);
+    LITTLE_ENDIAN_STORE((buffer + 8), record->arg1);
+    LITTLE_ENDIAN_STORE((buffer + 12), record->arg2);
+}
@@ -0,0 +1,163 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_TRACE_H
+#define LP_TRACE_H
+
+/* Function identifier prefix: lptr_ */
+
+/* Binary event trace. Each traced event is a fixed-size record, written to a
+ * RAM ring buffer in a few instructions. The ring is drained in the background
+ * as lp_frame frames (type LPFR_TYPE_TRACE), which host/lp_trace_dump decodes
+ * into a timeline.
+ *
+ * Use in a module:
+ *
+ *   #define LPTR_MODULE LPTR_MODULE_LPREQ
+ *   #include "lp_trace.h"
+ *   ...
+ *   LPTR_DEBUG(LPTR_EV_REQUEST_TX, packet_id, mask_low, mask_high);
+ *
+ * Trace frame content, after the type byte:
+ *
+ *  +----------------------+----------------------+---------------------------+
+ *  | ticks/s (16 bits)    | n_lost (16 bits)     | records (16 bytes each)   |
+ *  +----------------------+----------------------+---------------------------+
+ *
+ * Record:
+ *
+ *  +-------------+------------+-----------+-----------+-----------+-----------+
+ *  | time (32)   | module (8) | event (8) | arg0 (16) | arg1 (32) | arg2 (32) |
+ *  +-------------+------------+-----------+-----------+-----------+-----------+
+ *
+ * Little endian. time is in clock ticks, ticks/s gives their rate. n_lost
+ * counts the records dropped as the ring was full, before the older ones could
+ * be drained.
+ *
+ * The header does not depend on Mira, so that host tools can include it. */
+
+#include <stdint.h>
+
+#include "lp_frame.h"
+
+/* Compile out all tracing with LP_TRACE=0 */
+#ifndef LP_TRACE
+#define LP_TRACE (1)
+#endif
+
+/* Level of all modules at start, see lptr_level_set() */
+#ifndef LP_TRACE_DEFAULT_LEVEL
+#define LP_TRACE_DEFAULT_LEVEL LPTR_LEVEL_DEBUG
+#endif
+
+/* Number of records, power of two */
+#define LPTR_RING_SIZE (64)
+
+#define LPTR_RECORD_SIZE (16)
+#define LPTR_FRAME_HEADER_SIZE (1 + 2 + 2)
+#define LPTR_RECORDS_PER_FRAME (16)
+
+#define LPFR_TYPE_TRACE (0x02)
+
+typedef enum {
+    LPTR_LEVEL_OFF = 0,
+    LPTR_LEVEL_ERR,
+    LPTR_LEVEL_DEBUG,
+} lptr_level_t;
+
+typedef enum {
+    LPTR_MODULE_LP = 0,
+    LPTR_MODULE_LPSIG,
+    LPTR_MODULE_LPREQ,
+    LPTR_MODULE_LPSP,
+    LPTR_MODULE_LPACK,
+    LPTR_MODULE_LPD,
+    LPTR_MODULE_APP,
+    LPTR_MODULE_LPB,
+    LPTR_MODULE_LPSUB,
+    LPTR_MODULE_COUNT
+} lptr_module_t;
+
+/* Event ids, with their arguments (arg0, arg1, arg2). Only append, since the
+ * host tool decodes them by value. */
+typedef enum {
+    LPTR_EV_UDP_RX = 0,     /* src port, len, last 4 bytes of src address */
+    LPTR_EV_SIGNAL_TX,      /* packet id, n_sub_packets, flags */
+    LPTR_EV_SIGNAL_RX,      /* packet id, n_sub_packets, flags */
+    LPTR_EV_REQUEST_TX,     /* packet id, mask low, mask high */
+    LPTR_EV_REQUEST_RX,     /* packet id, mask low, mask high */
+    LPTR_EV_CANCEL_TX,      /* packet id, -, - */
+    LPTR_EV_CANCEL_RX,      /* packet id, -, - */
+    LPTR_EV_ACK_TX,         /* packet id, mask low, mask high */
+    LPTR_EV_ACK_RX,         /* packet id, mask low, mask high */
+    LPTR_EV_SUBPACKET_TX,   /* packet id, index, len */
+    LPTR_EV_SUBPACKET_RX,   /* packet id, index, len */
+    LPTR_EV_SUBPACKET_DROP, /* packet id, index, - */
+    LPTR_EV_RX_RESUME,      /* packet id, mask low, mask high */
+    LPTR_EV_RX_TIMEOUT,     /* packet id, requests left, - */
+    LPTR_EV_RX_ABORT,       /* packet id, -, - */
+    LPTR_EV_RX_DONE,        /* packet id, len, - */
+    LPTR_EV_TX_START,       /* packet id, mask low, mask high */
+    LPTR_EV_TX_END,         /* packet id, completed, - */
+    LPTR_EV_MCAST_ROUND,    /* packet id, mask low, mask high */
+    LPTR_EV_QUEUE_FULL,     /* -, number of overflows, - */
+    LPTR_EV_BUDGET_WAIT,    /* -, waiting time (ms), - */
+    LPTR_EV_TX_QUEUE_FULL,  /* packet id, index, - */
+    LPTR_EV_ANNOUNCE_END,   /* packet id, signals sent, replied */
+    LPTR_EV_SUBSCRIBE_TX,   /* -, period (ms), lifetime (s) */
+    LPTR_EV_SUBSCRIBE_RX,   /* -, period (ms), lifetime (s) */
+    LPTR_EV_COUNT
+} lptr_event_t;
+
+extern uint8_t lptr_levels[LPTR_MODULE_COUNT];
+
+#if LP_TRACE
+#define LPTR_AT(level, event, a0, a1, a2) do { \
+        if (lptr_levels[LPTR_MODULE] >= (level)) { \
+            lptr_record(LPTR_MODULE, event, a0, a1, a2); \
+        } \
+} while (0)
+#else
+#define LPTR_AT(level, event, a0, a1, a2)
+#endif
+
+/* Last 4 bytes of an IPv6 address, as a trace argument */
+#define LPTR_ADDRESS_TAIL(addr) \
+    ((uint32_t) ((const uint8_t *) (addr))[12] << 24 \
+     | (uint32_t) ((const uint8_t *) (addr))[13] << 16 \
+     | (uint32_t) ((const uint8_t *) (addr))[14] << 8 \
+     | (uint32_t) ((const uint8_t *) (addr))[15])
+
+/* Define LPTR_MODULE before including this header file, to use these. */
+#define LPTR_ERR(event, a0, a1, a2) LPTR_AT(LPTR_LEVEL_ERR, event, a0, a1, a2)
+#define LPTR_DEBUG(event, a0, a1, a2) LPTR_AT(LPTR_LEVEL_DEBUG, event, a0, a1, a2)
+
+/* Set all modules to LP_TRACE_DEFAULT_LEVEL, and start the drain process.
+ * Records are written with write, or kept in the ring only if write is NULL
+ * (see lptr_read()). Nothing is traced before this call. */
+void lptr_init(
+    lpfr_write_fn_t write,
+    void *ctx);
+
+/* Set the level of a module, records above it are not written. */
+void lptr_level_set(
+    lptr_module_t module,
+    lptr_level_t level);
+
+void lptr_record(
+    uint8_t module,
+    uint8_t event,
+    uint16_t arg0,
+    uint32_t arg1,
+    uint32_t arg2);
+
+/* Copy up to max_records serialized records out of the ring. Returns the number
+ * of records copied. */
+int lptr_read(
+    uint8_t *buffer,
+    int max_records);
+
+#endif
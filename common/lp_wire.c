@@ -0,0 +1,218 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#include "lp_codec.h"
+#include "lp_wire.h"
+
+// ******************************************************************************
+// Global variables
+// ******************************************************************************
+
+/* Large packet signal format:
+ *
+ *  +-------------------+----------------------+------------------------+----------------+
+ *  | header  (16 bits) |  packet_id (16_bits) | n_sub_packets (8 bits) | flags (8 bits) |
+ *  +-------------------+----------------------+------------------------+----------------+
+ *
+ * Little endian.
+ */
+static const lpc_field_t lpsig_fields[] = {
+    LPC_FIELD(lpsig_msg_t, packet_id),
+    LPC_FIELD(lpsig_msg_t, n_sub_packets),
+    LPC_FIELD(lpsig_msg_t, flags),
+};
+
+const lpc_schema_t lpsig_schema = LPC_SCHEMA(0x54, 0xab, lpsig_fields);
+
+/* Large packet signal of a segment format, for segments other than 0:
+ *
+ *  +-------------------+----------------------+------------------------+----------------+-------------------+
+ *  | header  (16 bits) |  packet_id (16_bits) | n_sub_packets (8 bits) | flags (8 bits) | segment (16 bits) |
+ *  +-------------------+----------------------+------------------------+----------------+-------------------+
+ *
+ * Little endian.
+ */
+static const lpc_field_t lpsig_segment_fields[] = {
+    LPC_FIELD(lpsig_msg_t, packet_id),
+    LPC_FIELD(lpsig_msg_t, n_sub_packets),
+    LPC_FIELD(lpsig_msg_t, flags),
+    LPC_FIELD(lpsig_msg_t, segment),
+};
+
+const lpc_schema_t lpsig_segment_schema =
+    LPC_SCHEMA(0x54, 0xac, lpsig_segment_fields);
+
+/* Large packet batch signal format:
+ *
+ *  +-------------------+---------------------+-----------------+-----+-----------------+
+ *  | header  (16 bits) | n_entries  (8 bits) | entry (48 bits) | ... | entry (48 bits) |
+ *  +-------------------+---------------------+-----------------+-----+-----------------+
+ *
+ * with each entry as in a signal of a segment: packet_id (16 bits),
+ * n_sub_packets (8 bits), flags (8 bits), segment (16 bits). Little endian.
+ */
+static const lpc_schema_t lpsig_entry_schema =
+    LPC_SCHEMA(0, 0, lpsig_segment_fields);
+
+static const lpc_field_t lpsig_batch_fields[] = {
+    LPC_FIELD(lpsig_batch_msg_t, n_entries),
+    LPC_RECORDS(
+        lpsig_batch_msg_t,
+        entries,
+        n_entries,
+        LPSIG_BATCH_MAX_ENTRIES,
+        lpsig_entry_schema),
+};
+
+const lpc_schema_t lpsig_batch_schema =
+    LPC_SCHEMA(0x54, 0xb5, lpsig_batch_fields);
+
+/* Large packet request format:
+ *
+ *  +-------------------+----------------------+----------------+------------------+
+ *  | header  (16 bits) |  packet_id (16_bits) | mask (64 bits) | period (16 bits) |
+ *  +-------------------+----------------------+----------------+------------------+
+ *
+ * Little endian.
+ */
+static const lpc_field_t lpreq_fields[] = {
+    LPC_FIELD(lpreq_msg_t, packet_id),
+    LPC_FIELD(lpreq_msg_t, mask),
+    LPC_FIELD(lpreq_msg_t, period_ms),
+};
+
+const lpc_schema_t lpreq_schema = LPC_SCHEMA(0xf2, 0x2a, lpreq_fields);
+
+/* Large packet request with session handle format:
+ *
+ *  +-------------------+----------------------+----------------+------------------+-------------------+
+ *  | header  (16 bits) |  packet_id (16_bits) | mask (64 bits) | period (16 bits) | session  (8 bits) |
+ *  +-------------------+----------------------+----------------+------------------+-------------------+
+ *
+ * Little endian.
+ */
+static const lpc_field_t lpreq_session_fields[] = {
+    LPC_FIELD(lpreq_msg_t, packet_id),
+    LPC_FIELD(lpreq_msg_t, mask),
+    LPC_FIELD(lpreq_msg_t, period_ms),
+    LPC_FIELD(lpreq_msg_t, session),
+};
+
+const lpc_schema_t lpreq_session_schema =
+    LPC_SCHEMA(0xf2, 0x2b, lpreq_session_fields);
+
+/* Large packet batch request format:
+ *
+ *  +-------------------+------------------+---------------------+-----------------+-----+-----------------+
+ *  | header  (16 bits) | period (16 bits) | n_entries  (8 bits) | entry (80 bits) | ... | entry (80 bits) |
+ *  +-------------------+------------------+---------------------+-----------------+-----+-----------------+
+ *
+ * with each entry as packet_id (16 bits), mask (64 bits). Little endian.
+ */
+static const lpc_field_t lpreq_entry_fields[] = {
+    LPC_FIELD(lpreq_entry_t, packet_id),
+    LPC_FIELD(lpreq_entry_t, sub_packet_mask),
+};
+
+static const lpc_schema_t lpreq_entry_schema =
+    LPC_SCHEMA(0, 0, lpreq_entry_fields);
+
+static const lpc_field_t lpreq_batch_fields[] = {
+    LPC_FIELD(lpreq_batch_msg_t, period_ms),
+    LPC_FIELD(lpreq_batch_msg_t, n_entries),
+    LPC_RECORDS(
+        lpreq_batch_msg_t,
+        entries,
+        n_entries,
+        LPREQ_BATCH_MAX_ENTRIES,
+        lpreq_entry_schema),
+};
+
+const lpc_schema_t lpreq_batch_schema =
+    LPC_SCHEMA(0xf2, 0x3b, lpreq_batch_fields);
+
+/* Large packet cancel format:
+ *
+ *  +-------------------+----------------------+
+ *  | header  (16 bits) |  packet_id (16_bits) |
+ *  +-------------------+----------------------+
+ *
+ * Little endian.
+ */
+static const lpc_field_t lpreq_cancel_fields[] = {
+    LPC_FIELD(lpreq_cancel_msg_t, packet_id),
+};
+
+const lpc_schema_t lpreq_cancel_schema =
+    LPC_SCHEMA(0xf2, 0xc5, lpreq_cancel_fields);
+
+/* Large packet acknowledgement format:
+ *
+ *  +-------------------+----------------------+-------------------------+
+ *  | header  (16 bits) |  packet_id (16_bits) | received mask (64 bits) |
+ *  +-------------------+----------------------+-------------------------+
+ *
+ * Little endian.
+ */
+static const lpc_field_t lpack_fields[] = {
+    LPC_FIELD(lpack_msg_t, packet_id),
+    LPC_FIELD(lpack_msg_t, mask),
+};
+
+const lpc_schema_t lpack_schema = LPC_SCHEMA(0xa6, 0xc1, lpack_fields);
+
+/* Sub-packet format:
+ *
+ *  +-------------------+----------------------+---------------------------+
+ *  | header  (16 bits) |  packet_id (16_bits) | sub_packet_index (8 bits) | ...
+ *  +-------------------+----------------------+------------------------+--+
+ *
+ *  +----------------------+-----------------------+-----------------------------+
+ *  n_sub_packets (8 bits) | payload_len (16 bits) | payload (payload_len bytes) |
+ *  +----------------------+-----------------------+-----------------------------+
+ *
+ * Little endian.
+ */
+static const lpc_field_t lpsp_fields[] = {
+    LPC_FIELD(lpsp_msg_t, packet_id),
+    LPC_FIELD(lpsp_msg_t, sub_packet_index),
+    LPC_FIELD(lpsp_msg_t, n_sub_packets),
+    LPC_FIELD(lpsp_msg_t, payload_len),
+    LPC_BYTES(lpsp_msg_t, payload, payload_len, LARGE_PACKET_SUBPACKET_MAX_BYTES),
+};
+
+const lpc_schema_t lpsp_schema = LPC_SCHEMA(0x1f, 0xb3, lpsp_fields);
+
+/* Compact sub-packet format:
+ *
+ *  +-------------------+-------------------+---------------------------+----------------------------------+
+ *  | header  (16 bits) | session  (8 bits) | sub_packet_index (8 bits) | payload (to the end of datagram) |
+ *  +-------------------+-------------------+---------------------------+----------------------------------+
+ */
+static const lpc_field_t lpsp_compact_fields[] = {
+    LPC_FIELD(lpsp_compact_msg_t, session),
+    LPC_FIELD(lpsp_compact_msg_t, sub_packet_index),
+    LPC_TAIL(lpsp_compact_msg_t, payload, payload_len, LARGE_PACKET_SUBPACKET_MAX_BYTES),
+};
+
+const lpc_schema_t lpsp_compact_schema =
+    LPC_SCHEMA(0x1f, 0xc4, lpsp_compact_fields);
+
+/* Large packet subscription format:
+ *
+ *  +-------------------+------------------+----------------------+
+ *  | header  (16 bits) | period (16 bits) | lifetime_s (16 bits) |
+ *  +-------------------+------------------+----------------------+
+ *
+ * Little endian.
+ */
+static const lpc_field_t lpsub_fields[] = {
+    LPC_FIELD(lpsub_msg_t, period_ms),
+    LPC_FIELD(lpsub_msg_t, lifetime_s),
+};
+
+const lpc_schema_t lpsub_schema = LPC_SCHEMA(0x5c, 0x71, lpsub_fields);
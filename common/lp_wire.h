@@ -0,0 +1,152 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_WIRE_H
+#define LP_WIRE_H
+
+/* Wire format of the large packet messages: protocol constants, message types
+ * and their codec schemas (see lp_codec.h). Shared by the message modules of
+ * the Mira nodes (lp_signal, lp_request, ...) and the Linux receiver (see
+ * host/lp_rx.h), so it does not depend on Mira. */
+
+#include <stdint.h>
+
+#include "lp_codec.h"
+
+/* Open port receiver for signals */
+#define LARGE_PACKET_RX_UDP_PORT   (1520)
+
+/* Size of single frames to split the large packet into.  This size may be
+ * larger than max payload for a single radio packet, in which case Mira
+ * (6LoWPAN) divides the sub-packet into fragments. This has the advantage of
+ * reducing overhead, at the cost of possible increase of number
+ * re-transmissions. */
+#define LARGE_PACKET_SUBPACKET_MAX_BYTES     (330)
+
+/* Max number of messages into which a large packet may be split */
+/* The bit mask sent in requests must be large enough to accommodate for this
+ * number of sub-packets. */
+#define LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS  (64)
+
+/* Byte size of a segment: larger objects are sent as consecutive large
+ * packets, each signaled with its segment number, and written at byte offset
+ * segment * LARGE_PACKET_SEGMENT_MAX_BYTES of the object. All segments but the
+ * last one are whole. */
+#define LARGE_PACKET_SEGMENT_MAX_BYTES \
+    (LARGE_PACKET_SUBPACKET_MAX_BYTES * LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS)
+
+/* Sub-packet period used when pushing. */
+#define LARGE_PACKET_PUSH_PERIOD_MS  (800)
+
+/* Signal flags */
+/* Sub-packets follow the signal without waiting for a request. The receiver
+ * only requests the sub-packets that went missing. */
+#define LPSIG_FLAG_PUSH (0x01)
+/* With LPSIG_FLAG_PUSH: pushed to a subscriber, at the sub-packet period of
+ * its subscription (see lp_subscription.h). */
+#define LPSIG_FLAG_SUBSCRIBED (0x02)
+
+/* Max number of large packets in a batch signal. Each is posted as a separate
+ * event, taking a slot of the dispatch queue (see LPD_QUEUE_DEPTH). */
+#ifndef LPSIG_BATCH_MAX_ENTRIES
+#define LPSIG_BATCH_MAX_ENTRIES (4)
+#endif
+
+/* Max number of large packets in a batch request. Each is posted as a separate
+ * event, taking a slot of the dispatch queue (see LPD_QUEUE_DEPTH). */
+#ifndef LPREQ_BATCH_MAX_ENTRIES
+#define LPREQ_BATCH_MAX_ENTRIES (4)
+#endif
+
+/* Signal */
+typedef struct {
+    uint16_t packet_id;
+    uint8_t n_sub_packets;
+    uint8_t flags;
+    /* Segment of a larger object, lpsig_segment_schema and batch signals only.
+     * 0 otherwise. */
+    uint16_t segment;
+} lpsig_msg_t;
+
+/* Batch signal, each entry a large packet signaled as by a signal of its own */
+typedef struct {
+    uint8_t n_entries;
+    lpsig_msg_t entries[LPSIG_BATCH_MAX_ENTRIES];
+} lpsig_batch_msg_t;
+
+/* Session handle of a request: none, the sub-packets carry their whole
+ * header. */
+#define LPREQ_NO_SESSION (0)
+
+/* Request */
+typedef struct {
+    uint16_t packet_id;
+    uint64_t mask;
+    uint16_t period_ms;
+    /* Assigned by the receiver, to be sent back in compact sub-packets, in
+     * place of packet_id and n_sub_packets. lpreq_session_schema only. */
+    uint8_t session;
+} lpreq_msg_t;
+
+/* A large packet in a batch request, with the sub-packets to send */
+typedef struct {
+    uint16_t packet_id;
+    uint64_t sub_packet_mask;
+} lpreq_entry_t;
+
+typedef struct {
+    uint16_t period_ms;
+    uint8_t n_entries;
+    lpreq_entry_t entries[LPREQ_BATCH_MAX_ENTRIES];
+} lpreq_batch_msg_t;
+
+typedef struct {
+    uint16_t packet_id;
+} lpreq_cancel_msg_t;
+
+/* Acknowledgement */
+typedef struct {
+    uint16_t packet_id;
+    uint64_t mask;
+} lpack_msg_t;
+
+/* Sub-packet */
+typedef struct {
+    uint16_t packet_id;
+    uint8_t sub_packet_index;
+    uint8_t n_sub_packets;
+    uint16_t payload_len;
+    const uint8_t *payload;
+} lpsp_msg_t;
+
+/* Compact sub-packet, of a request with a session handle. The payload runs to
+ * the end of the datagram. */
+typedef struct {
+    uint8_t session;
+    uint8_t sub_packet_index;
+    uint16_t payload_len;
+    const uint8_t *payload;
+} lpsp_compact_msg_t;
+
+/* Subscription */
+typedef struct {
+    uint16_t period_ms;
+    uint16_t lifetime_s;
+} lpsub_msg_t;
+
+extern const lpc_schema_t lpsig_schema;
+extern const lpc_schema_t lpsig_segment_schema;
+extern const lpc_schema_t lpsig_batch_schema;
+extern const lpc_schema_t lpreq_schema;
+extern const lpc_schema_t lpreq_session_schema;
+extern const lpc_schema_t lpreq_batch_schema;
+extern const lpc_schema_t lpreq_cancel_schema;
+extern const lpc_schema_t lpack_schema;
+extern const lpc_schema_t lpsp_schema;
+extern const lpc_schema_t lpsp_compact_schema;
+extern const lpc_schema_t lpsub_schema;
+
+#endif
@@ -0,0 +1,143 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#include <string.h>
+
+#include "lp_frame_decoder.h"
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static int lpfd_frame_end(
+    lpfd_decoder_t *dec);
+
+static void lpfd_reset(
+    lpfd_decoder_t *dec);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+void lpfd_init(
+    lpfd_decoder_t *dec,
+    lpfd_packet_fn_t on_packet,
+    void *ctx)
+{
+    memset(&dec->stats, 0, sizeof(dec->stats));
+    dec->on_packet = on_packet;
+    dec->on_frame = NULL;
+    dec->ctx = ctx;
+    lpfd_reset(dec);
+}
+
+void lpfd_frame_handler_set(
+    lpfd_decoder_t *dec,
+    lpfd_frame_fn_t on_frame)
+{
+    dec->on_frame = on_frame;
+}
+
+int lpfd_feed(
+    lpfd_decoder_t *dec,
+    const uint8_t *data,
+    size_t len)
+{
+    int n_packets = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t byte = data[i];
+
+        if (byte == LPFR_DELIMITER) {
+            n_packets += lpfd_frame_end(dec);
+            lpfd_reset(dec);
+            continue;
+        }
+        if (dec->discard) {
+            continue;
+        }
+
+        if (dec->left == 0) {
+            /* New block. The previous one ended with an implicit zero, unless
+             * it was a full block. */
+            if (dec->code != 0 && dec->code != 0xff) {
+                if (dec->len == sizeof(dec->frame)) {
+                    dec->discard = 1;
+                    continue;
+                }
+                dec->frame[dec->len++] = 0;
+            }
+            dec->code = byte;
+            dec->left = byte - 1;
+        } else {
+            if (dec->len == sizeof(dec->frame)) {
+                dec->discard = 1;
+                continue;
+            }
+            dec->frame[dec->len++] = byte;
+            dec->left--;
+        }
+    }
+
+    return n_packets;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static int lpfd_frame_end(
+    lpfd_decoder_t *dec)
+{
+    lpfd_packet_t packet;
+    const uint8_t *p = dec->frame;
+    uint16_t crc;
+
+    if (dec->len == 0 && !dec->discard) {
+        /* Back-to-back delimiters */
+        return 0;
+    }
+    if (dec->discard || dec->left != 0 ||
+        dec->len < LPFR_HEADER_SIZE + LPFR_CRC_SIZE) {
+        dec->stats.n_malformed++;
+        return 0;
+    }
+
+    crc = dec->frame[dec->len - 2] | (dec->frame[dec->len - 1] << 8);
+    if (lpfr_crc16(0xffff, dec->frame, dec->len - LPFR_CRC_SIZE) != crc) {
+        dec->stats.n_crc_errors++;
+        return 0;
+    }
+
+    if (*p != LPFR_TYPE_LARGE_PACKET) {
+        dec->stats.n_frames++;
+        if (dec->on_frame != NULL) {
+            dec->on_frame(dec->ctx, *p, p + 1, dec->len - 1 - LPFR_CRC_SIZE);
+        }
+        return 0;
+    }
+    p++;
+    memcpy(packet.src, p, LPFR_ADDRESS_SIZE);
+    p += LPFR_ADDRESS_SIZE;
+    packet.packet_id = p[0] | (p[1] << 8);
+    packet.len = p[2] | (p[3] << 8);
+    p += 4;
+    packet.payload = p;
+
+    if (LPFR_HEADER_SIZE + packet.len + LPFR_CRC_SIZE != dec->len) {
+        dec->stats.n_malformed++;
+        return 0;
+    }
+
+    dec->stats.n_frames++;
+    dec->on_packet(dec->ctx, &packet);
+    return 1;
+}
+
+static void lpfd_reset(
+    lpfd_decoder_t *dec)
+{
+    dec->len = 0;
+    dec->code = 0;
+    dec->left = 0;
+    dec->discard = 0;
+}
@@ -0,0 +1,78 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_FRAME_DECODER_H
+#define LP_FRAME_DECODER_H
+
+/* Function identifier prefix: lpfd_ */
+
+/* Decoder of the binary frames written by a receiver, see lp_frame.h. Bytes
+ * are fed as they arrive from the serial line, and each complete large packet
+ * is handed to a callback, directly from the decoder's buffer. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lp_frame.h"
+
+/* Largest frame content, with a 64 * 330 bytes large packet */
+#define LPFD_MAX_FRAME_SIZE (LPFR_HEADER_SIZE + 64 * 330 + LPFR_CRC_SIZE)
+
+typedef struct {
+    uint8_t src[LPFR_ADDRESS_SIZE];
+    uint16_t packet_id;
+    uint16_t len;
+    const uint8_t *payload;
+} lpfd_packet_t;
+
+/* Called for each decoded large packet. The packet is valid during the call. */
+typedef void (*lpfd_packet_fn_t)(
+    void *ctx,
+    const lpfd_packet_t *packet);
+
+/* Called for each valid frame of another type than LPFR_TYPE_LARGE_PACKET,
+ * with the content after the type byte. */
+typedef void (*lpfd_frame_fn_t)(
+    void *ctx,
+    uint8_t type,
+    const uint8_t *data,
+    size_t len);
+
+typedef struct {
+    uint32_t n_frames;
+    uint32_t n_crc_errors;
+    uint32_t n_malformed;
+} lpfd_stats_t;
+
+typedef struct {
+    lpfd_packet_fn_t on_packet;
+    lpfd_frame_fn_t on_frame;
+    void *ctx;
+    lpfd_stats_t stats;
+    size_t len;
+    uint8_t code;
+    uint8_t left;
+    int discard;
+    uint8_t frame[LPFD_MAX_FRAME_SIZE];
+} lpfd_decoder_t;
+
+void lpfd_init(
+    lpfd_decoder_t *dec,
+    lpfd_packet_fn_t on_packet,
+    void *ctx);
+
+/* Handle the other frame types too, e.g. traces (see lp_trace.h). */
+void lpfd_frame_handler_set(
+    lpfd_decoder_t *dec,
+    lpfd_frame_fn_t on_frame);
+
+/* Feed received bytes. Returns the number of packets completed. */
+int lpfd_feed(
+    lpfd_decoder_t *dec,
+    const uint8_t *data,
+    size_t len);
+
+#endif
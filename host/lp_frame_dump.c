@@ -0,0 +1,159 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+
+This example is provided as is, without warranty.
+----------------------------------------------------------------------------*/
+
+/* Reads binary frames from a receiver's UART (or stdin), and prints one line
+ * per received large packet. With -d, each payload is also written to a file
+ * in the given directory.
+ *
+ * Usage: lp_frame_dump [-b baudrate] [-d dir] [device]
+ */
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "lp_frame_decoder.h"
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static lpfd_decoder_t decoder;
+static const char *output_dir;
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static int serial_configure(
+    int fd,
+    long baudrate);
+
+static void packet_print(
+    void *ctx,
+    const lpfd_packet_t *packet);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int main(
+    int argc,
+    char *argv[])
+{
+    long baudrate = 115200;
+    int fd = STDIN_FILENO;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:d:")) != -1) {
+        switch (opt) {
+        case 'b':
+            baudrate = strtol(optarg, NULL, 10);
+            break;
+        case 'd':
+            output_dir = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-b baudrate] [-d dir] [device]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind < argc) {
+        fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+    if (isatty(fd) && serial_configure(fd, baudrate) < 0) {
+        fprintf(stderr, "Could not configure serial port\n");
+        return 1;
+    }
+
+    lpfd_init(&decoder, packet_print, NULL);
+
+    while (1) {
+        uint8_t buf[4096];
+        ssize_t n = read(fd, buf, sizeof(buf));
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        lpfd_feed(&decoder, buf, n);
+    }
+
+    fprintf(stderr, "%u frames, %u CRC errors, %u malformed\n",
+        decoder.stats.n_frames,
+        decoder.stats.n_crc_errors,
+        decoder.stats.n_malformed);
+    return 0;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static int serial_configure(
+    int fd,
+    long baudrate)
+{
+    struct termios tio;
+    speed_t speed;
+
+    switch (baudrate) {
+    case 115200: speed = B115200; break;
+    case 230400: speed = B230400; break;
+    case 460800: speed = B460800; break;
+    case 921600: speed = B921600; break;
+    case 1000000: speed = B1000000; break;
+    default: return -1;
+    }
+
+    if (tcgetattr(fd, &tio) < 0) {
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static void packet_print(
+    void *ctx,
+    const lpfd_packet_t *packet)
+{
+    char addr[40];
+    char *p = addr;
+
+    for (int i = 0; i < LPFR_ADDRESS_SIZE; i += 2) {
+        p += sprintf(p, "%s%02x%02x", i ? ":" : "", packet->src[i], packet->src[i + 1]);
+    }
+    printf("%s id %u, %u bytes\n", addr, packet->packet_id, packet->len);
+    fflush(stdout);
+
+    if (output_dir) {
+        char path[512];
+        FILE *f;
+
+        snprintf(path, sizeof(path), "%s/%s_%u.bin", output_dir, addr, packet->packet_id);
+        f = fopen(path, "wb");
+        if (!f) {
+            perror(path);
+            return;
+        }
+        fwrite(packet->payload, 1, packet->len, f);
+        fclose(f);
+    }
+}
@@ -0,0 +1,283 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+
+This example is provided as is, without warranty.
+----------------------------------------------------------------------------*/
+
+/* Ingests the large packets of several roots at once (see lp_ingest.h), from
+ * their UARTs, or any stream of binary frames, e.g. a pipe from lp_rxd. With
+ * -d, each payload is written to a file in the given directory. Every
+ * interval, a line per stage reports its throughput and load, with the backlog
+ * of decoded large packets.
+ *
+ * Usage: lp_gateway [-b baudrate] [-w workers] [-q queue_depth] [-i interval_s]
+ *                   [-d dir] stream...
+ */
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lp_ingest.h"
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static volatile sig_atomic_t running = 1;
+static const char *output_dir;
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static void stop(
+    int sig);
+
+static int serial_configure(
+    int fd,
+    long baudrate);
+
+static void packet_write(
+    void *ctx,
+    unsigned stream,
+    const lpin_packet_t *packet);
+
+static void stage_print(
+    const char *name,
+    const lpin_stage_stats_t *now,
+    const lpin_stage_stats_t *before,
+    double interval_s);
+
+static void stats_print(
+    const lpin_stats_t *now,
+    const lpin_stats_t *before,
+    double interval_s);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int main(
+    int argc,
+    char *argv[])
+{
+    lpin_config_t config = {
+        .n_workers = 4,
+        .queue_depth = 64,
+        .transform = NULL,
+        .sink = packet_write,
+        .ctx = NULL,
+    };
+    lpin_stats_t before;
+    lpin_stats_t now;
+    struct sigaction sa;
+    long baudrate = 115200;
+    unsigned interval_s = 1;
+    lpin_t *in;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "b:w:q:i:d:")) != -1) {
+        switch (opt) {
+        case 'b':
+            baudrate = strtol(optarg, NULL, 10);
+            break;
+        case 'w':
+            config.n_workers = strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            config.queue_depth = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            interval_s = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            output_dir = optarg;
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (optind >= argc || interval_s == 0) {
+        fprintf(stderr, "Usage: %s [-b baudrate] [-w workers] [-q queue_depth] "
+            "[-i interval_s] [-d dir] stream...\n", argv[0]);
+        return 1;
+    }
+
+    in = lpin_create(&config);
+    if (in == NULL) {
+        fprintf(stderr, "Queue depth is a power of two\n");
+        return 1;
+    }
+
+    for (i = optind; i < argc; i++) {
+        int fd = strcmp(argv[i], "-") == 0
+            ? STDIN_FILENO
+            : open(argv[i], O_RDONLY | O_NOCTTY);
+
+        if (fd < 0) {
+            perror(argv[i]);
+            return 1;
+        }
+        if (isatty(fd) && serial_configure(fd, baudrate) < 0) {
+            fprintf(stderr, "%s: could not configure serial port\n", argv[i]);
+            return 1;
+        }
+        if (lpin_stream_add(in, fd) < 0) {
+            fprintf(stderr, "At most %d streams\n", LPIN_MAX_STREAMS);
+            return 1;
+        }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (lpin_start(in) < 0) {
+        return 1;
+    }
+
+    memset(&before, 0, sizeof(before));
+    for (;;) {
+        unsigned left = interval_s;
+
+        while (left > 0 && running) {
+            left = sleep(left);
+        }
+        lpin_stats_get(in, &now);
+        if (!running || now.n_streams_open == 0) {
+            break;
+        }
+        stats_print(&now, &before, interval_s);
+        before = now;
+    }
+
+    lpin_stop(in);
+    lpin_stats_get(in, &now);
+    memset(&before, 0, sizeof(before));
+    fprintf(stderr, "Total:\n");
+    stats_print(&now, &before, 0);
+    lpin_destroy(in);
+    return 0;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static void stop(
+    int sig)
+{
+    (void) sig;
+    running = 0;
+}
+
+static int serial_configure(
+    int fd,
+    long baudrate)
+{
+    struct termios tio;
+    speed_t speed;
+
+    switch (baudrate) {
+    case 115200: speed = B115200; break;
+    case 230400: speed = B230400; break;
+    case 460800: speed = B460800; break;
+    case 921600: speed = B921600; break;
+    case 1000000: speed = B1000000; break;
+    default: return -1;
+    }
+
+    if (tcgetattr(fd, &tio) < 0) {
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static void packet_write(
+    void *ctx,
+    unsigned stream,
+    const lpin_packet_t *packet)
+{
+    char path[512];
+    char *p;
+    FILE *f;
+    int n;
+
+    (void) ctx;
+
+    if (!output_dir) {
+        return;
+    }
+
+    /* Streams are sunk concurrently, every file has its own name */
+    n = snprintf(path, sizeof(path), "%s/%u_", output_dir, stream);
+    p = path + n;
+    for (int i = 0; i < LPFR_ADDRESS_SIZE; i += 2) {
+        p += sprintf(p, "%s%02x%02x", i ? ":" : "", packet->src[i], packet->src[i + 1]);
+    }
+    sprintf(p, "_%u.bin", packet->packet_id);
+
+    f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    fwrite(packet->payload, 1, packet->len, f);
+    fclose(f);
+}
+
+static void stage_print(
+    const char *name,
+    const lpin_stage_stats_t *now,
+    const lpin_stage_stats_t *before,
+    double interval_s)
+{
+    uint64_t n_packets = now->n_packets - before->n_packets;
+    uint64_t n_bytes = now->n_bytes - before->n_bytes;
+    double busy_s = (now->busy_ns - before->busy_ns) / 1e9;
+
+    if (interval_s > 0) {
+        fprintf(stderr, "  %-9s %9.1f pkt/s %9.3f MB/s %6.1f%% busy\n",
+            name,
+            n_packets / interval_s,
+            n_bytes / interval_s / 1e6,
+            100 * busy_s / interval_s);
+    } else {
+        fprintf(stderr, "  %-9s %9llu pkts %9.3f MB %9.3f s busy\n",
+            name,
+            (unsigned long long) n_packets,
+            n_bytes / 1e6,
+            busy_s);
+    }
+}
+
+static void stats_print(
+    const lpin_stats_t *now,
+    const lpin_stats_t *before,
+    double interval_s)
+{
+    stage_print("decode", &now->decode, &before->decode, interval_s);
+    stage_print("transform", &now->transform, &before->transform, interval_s);
+    stage_print("sink", &now->sink, &before->sink, interval_s);
+    fprintf(stderr, "  backlog %u, %llu stalls, %llu CRC errors, %llu malformed, "
+        "%u streams open\n",
+        now->backlog,
+        (unsigned long long) now->n_stalls,
+        (unsigned long long) now->n_crc_errors,
+        (unsigned long long) now->n_malformed,
+        now->n_streams_open);
+}
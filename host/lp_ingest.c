@@ -0,0 +1,611 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lp_frame_decoder.h"
+#include "lp_ingest.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+// ******************************************************************************
+// Module constants
+// ******************************************************************************
+#define LPIN_CACHE_LINE (64)
+
+/* Large packets taken from a queue at once, before looking at the next one */
+#define LPIN_WORKER_BATCH (16)
+
+/* Decode threads check for lpin_stop() this often */
+#define LPIN_POLL_TIMEOUT_MS (100)
+
+#define LPIN_STALL_SLEEP_US (100)
+
+#define LPIN_READ_BYTES (4096)
+
+// ******************************************************************************
+// Module types
+// ******************************************************************************
+typedef struct {
+    uint8_t src[LPFR_ADDRESS_SIZE];
+    uint16_t packet_id;
+    size_t len;
+    uint8_t payload[LPFD_MAX_FRAME_SIZE];
+} lpin_item_t;
+
+/* Lock-free ring, pushed by one thread and popped by another. Head and tail
+ * are on cache lines of their own, not to bounce between the two. */
+typedef struct {
+    lpin_item_t **items;
+    uint32_t mask;
+    uint32_t head __attribute__((aligned(LPIN_CACHE_LINE))); /* popped */
+    uint32_t tail __attribute__((aligned(LPIN_CACHE_LINE))); /* pushed */
+} lpin_spsc_t;
+
+typedef struct lpin_worker {
+    lpin_t *in;
+    pthread_t thread;
+    int event_fd;
+    int sleeping;
+    uint8_t *out;
+    lpin_stage_stats_t transform;
+    lpin_stage_stats_t sink;
+    uint64_t n_transform_errors;
+} lpin_worker_t;
+
+typedef struct {
+    lpin_t *in;
+    unsigned index;
+    int fd;
+    pthread_t thread;
+    lpin_worker_t *worker;
+    int ended;
+
+    lpfd_decoder_t decoder;
+    lpin_stage_stats_t decode;
+    uint64_t n_stalls;
+    uint64_t stall_ns; /* of the ongoing feed, not counted busy */
+
+    /* Decoded large packets to the worker, and the items back */
+    lpin_spsc_t full;
+    lpin_spsc_t free;
+    lpin_item_t *items;
+} lpin_stream_t;
+
+struct lpin {
+    lpin_config_t config;
+    int stop;
+    unsigned n_streams;
+    unsigned n_workers;
+    lpin_stream_t *streams[LPIN_MAX_STREAMS];
+    lpin_worker_t workers[LPIN_MAX_WORKERS];
+};
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static uint64_t now_ns(
+    void);
+
+static int spsc_init(
+    lpin_spsc_t *q,
+    uint32_t size);
+
+static bool spsc_push(
+    lpin_spsc_t *q,
+    lpin_item_t *item);
+
+static lpin_item_t *spsc_pop(
+    lpin_spsc_t *q);
+
+static uint32_t spsc_len(
+    lpin_spsc_t *q);
+
+static void worker_signal(
+    lpin_worker_t *w);
+
+static void worker_wake(
+    lpin_worker_t *w);
+
+static void packet_decoded(
+    void *ctx,
+    const lpfd_packet_t *packet);
+
+static void *decode_thread(
+    void *arg);
+
+static bool worker_drain(
+    lpin_worker_t *w,
+    bool *all_ended);
+
+static void item_process(
+    lpin_worker_t *w,
+    unsigned stream,
+    const lpin_item_t *item);
+
+static void *worker_thread(
+    void *arg);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+lpin_t *lpin_create(
+    const lpin_config_t *config)
+{
+    lpin_t *in;
+    unsigned i;
+
+    if (config->sink == NULL
+        || config->queue_depth == 0
+        || (config->queue_depth & (config->queue_depth - 1)) != 0) {
+        P_ERR("%s: bad configuration\n", __func__);
+        return NULL;
+    }
+
+    in = calloc(1, sizeof(*in));
+    if (in == NULL) {
+        return NULL;
+    }
+    in->config = *config;
+    for (i = 0; i < LPIN_MAX_WORKERS; i++) {
+        in->workers[i].event_fd = -1;
+    }
+    in->n_workers = config->n_workers;
+    if (in->n_workers == 0) {
+        in->n_workers = 1;
+    }
+    if (in->n_workers > LPIN_MAX_WORKERS) {
+        in->n_workers = LPIN_MAX_WORKERS;
+    }
+    return in;
+}
+
+int lpin_stream_add(
+    lpin_t *in,
+    int fd)
+{
+    lpin_stream_t *s;
+    uint32_t i;
+
+    if (in->n_streams >= LPIN_MAX_STREAMS) {
+        return -1;
+    }
+
+    s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return -1;
+    }
+    s->items = calloc(in->config.queue_depth, sizeof(*s->items));
+    if (s->items == NULL
+        || spsc_init(&s->full, in->config.queue_depth) < 0
+        || spsc_init(&s->free, in->config.queue_depth) < 0) {
+        free(s->items);
+        free(s->full.items);
+        free(s->free.items);
+        free(s);
+        return -1;
+    }
+    for (i = 0; i < in->config.queue_depth; i++) {
+        spsc_push(&s->free, &s->items[i]);
+    }
+
+    s->in = in;
+    s->index = in->n_streams;
+    s->fd = fd;
+    lpfd_init(&s->decoder, packet_decoded, s);
+
+    in->streams[in->n_streams] = s;
+    return in->n_streams++;
+}
+
+int lpin_start(
+    lpin_t *in)
+{
+    unsigned i;
+
+    if (in->n_workers > in->n_streams) {
+        in->n_workers = in->n_streams;
+    }
+
+    for (i = 0; i < in->n_streams; i++) {
+        in->streams[i]->worker = &in->workers[i % in->n_workers];
+    }
+
+    for (i = 0; i < in->n_workers; i++) {
+        lpin_worker_t *w = &in->workers[i];
+
+        w->in = in;
+        w->event_fd = eventfd(0, 0);
+        if (w->event_fd < 0) {
+            P_ERR("%s: eventfd\n", __func__);
+            return -1;
+        }
+        if (in->config.transform != NULL) {
+            w->out = malloc(in->config.transform_max_len);
+            if (w->out == NULL) {
+                return -1;
+            }
+        }
+        if (pthread_create(&w->thread, NULL, worker_thread, w) != 0) {
+            P_ERR("%s: pthread_create\n", __func__);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < in->n_streams; i++) {
+        if (pthread_create(&in->streams[i]->thread, NULL,
+                decode_thread, in->streams[i]) != 0) {
+            P_ERR("%s: pthread_create\n", __func__);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void lpin_stats_get(
+    lpin_t *in,
+    lpin_stats_t *stats)
+{
+    unsigned i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (i = 0; i < in->n_streams; i++) {
+        lpin_stream_t *s = in->streams[i];
+
+        stats->decode.n_packets +=
+            __atomic_load_n(&s->decode.n_packets, __ATOMIC_RELAXED);
+        stats->decode.n_bytes +=
+            __atomic_load_n(&s->decode.n_bytes, __ATOMIC_RELAXED);
+        stats->decode.busy_ns +=
+            __atomic_load_n(&s->decode.busy_ns, __ATOMIC_RELAXED);
+        stats->n_crc_errors +=
+            __atomic_load_n(&s->decoder.stats.n_crc_errors, __ATOMIC_RELAXED);
+        stats->n_malformed +=
+            __atomic_load_n(&s->decoder.stats.n_malformed, __ATOMIC_RELAXED);
+        stats->n_stalls += __atomic_load_n(&s->n_stalls, __ATOMIC_RELAXED);
+        stats->backlog += spsc_len(&s->full);
+        if (!__atomic_load_n(&s->ended, __ATOMIC_RELAXED)) {
+            stats->n_streams_open++;
+        }
+    }
+
+    for (i = 0; i < in->n_workers; i++) {
+        lpin_worker_t *w = &in->workers[i];
+
+        stats->transform.n_packets +=
+            __atomic_load_n(&w->transform.n_packets, __ATOMIC_RELAXED);
+        stats->transform.n_bytes +=
+            __atomic_load_n(&w->transform.n_bytes, __ATOMIC_RELAXED);
+        stats->transform.busy_ns +=
+            __atomic_load_n(&w->transform.busy_ns, __ATOMIC_RELAXED);
+        stats->sink.n_packets +=
+            __atomic_load_n(&w->sink.n_packets, __ATOMIC_RELAXED);
+        stats->sink.n_bytes +=
+            __atomic_load_n(&w->sink.n_bytes, __ATOMIC_RELAXED);
+        stats->sink.busy_ns +=
+            __atomic_load_n(&w->sink.busy_ns, __ATOMIC_RELAXED);
+        stats->n_transform_errors +=
+            __atomic_load_n(&w->n_transform_errors, __ATOMIC_RELAXED);
+    }
+}
+
+void lpin_wait(
+    lpin_t *in)
+{
+    unsigned i;
+
+    for (i = 0; i < in->n_streams; i++) {
+        pthread_join(in->streams[i]->thread, NULL);
+    }
+    for (i = 0; i < in->n_workers; i++) {
+        pthread_join(in->workers[i].thread, NULL);
+    }
+}
+
+void lpin_stop(
+    lpin_t *in)
+{
+    __atomic_store_n(&in->stop, 1, __ATOMIC_RELAXED);
+    lpin_wait(in);
+}
+
+void lpin_destroy(
+    lpin_t *in)
+{
+    unsigned i;
+
+    for (i = 0; i < in->n_streams; i++) {
+        lpin_stream_t *s = in->streams[i];
+
+        free(s->items);
+        free(s->full.items);
+        free(s->free.items);
+        free(s);
+    }
+    for (i = 0; i < in->n_workers; i++) {
+        if (in->workers[i].event_fd >= 0) {
+            close(in->workers[i].event_fd);
+        }
+        free(in->workers[i].out);
+    }
+    free(in);
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static uint64_t now_ns(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int spsc_init(
+    lpin_spsc_t *q,
+    uint32_t size)
+{
+    q->items = calloc(size, sizeof(*q->items));
+    q->mask = size - 1;
+    q->head = 0;
+    q->tail = 0;
+    return q->items != NULL ? 0 : -1;
+}
+
+static bool spsc_push(
+    lpin_spsc_t *q,
+    lpin_item_t *item)
+{
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+    if (tail - head > q->mask) {
+        return false;
+    }
+    q->items[tail & q->mask] = item;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static lpin_item_t *spsc_pop(
+    lpin_spsc_t *q)
+{
+    uint32_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    lpin_item_t *item;
+
+    if (head == tail) {
+        return NULL;
+    }
+    item = q->items[head & q->mask];
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+static uint32_t spsc_len(
+    lpin_spsc_t *q)
+{
+    return __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)
+           - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+}
+
+static void worker_signal(
+    lpin_worker_t *w)
+{
+    uint64_t one = 1;
+
+    if (write(w->event_fd, &one, sizeof(one)) < 0) {
+        P_ERR("%s: eventfd write\n", __func__);
+    }
+}
+
+static void worker_wake(
+    lpin_worker_t *w)
+{
+    /* Pairs with the fence of worker_thread(): either the worker sees what was
+     * pushed, or this sees it sleeping */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->sleeping, __ATOMIC_RELAXED)) {
+        worker_signal(w);
+    }
+}
+
+static void packet_decoded(
+    void *ctx,
+    const lpfd_packet_t *packet)
+{
+    lpin_stream_t *s = (lpin_stream_t *) ctx;
+    lpin_item_t *item = spsc_pop(&s->free);
+
+    if (item == NULL) {
+        uint64_t start = now_ns();
+
+        __atomic_fetch_add(&s->n_stalls, 1, __ATOMIC_RELAXED);
+        while ((item = spsc_pop(&s->free)) == NULL) {
+            usleep(LPIN_STALL_SLEEP_US);
+        }
+        s->stall_ns += now_ns() - start;
+    }
+
+    memcpy(item->src, packet->src, sizeof(item->src));
+    item->packet_id = packet->packet_id;
+    item->len = packet->len;
+    memcpy(item->payload, packet->payload, packet->len);
+
+    /* As many items as room in the queue */
+    spsc_push(&s->full, item);
+    __atomic_fetch_add(&s->decode.n_packets, 1, __ATOMIC_RELAXED);
+    worker_wake(s->worker);
+}
+
+static void *decode_thread(
+    void *arg)
+{
+    lpin_stream_t *s = (lpin_stream_t *) arg;
+    struct pollfd pfd = {
+        .fd = s->fd,
+        .events = POLLIN,
+    };
+    uint8_t buf[LPIN_READ_BYTES];
+
+    while (!__atomic_load_n(&s->in->stop, __ATOMIC_RELAXED)) {
+        uint64_t start;
+        ssize_t n;
+        int ret = poll(&pfd, 1, LPIN_POLL_TIMEOUT_MS);
+
+        if (ret < 0 && errno != EINTR) {
+            P_ERR("%s: stream %u: poll\n", __func__, s->index);
+            break;
+        }
+        if (ret <= 0) {
+            continue;
+        }
+
+        n = read(s->fd, buf, sizeof(buf));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+
+        start = now_ns();
+        s->stall_ns = 0;
+        lpfd_feed(&s->decoder, buf, n);
+        __atomic_fetch_add(&s->decode.n_bytes, n, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->decode.busy_ns, now_ns() - start - s->stall_ns,
+            __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&s->ended, 1, __ATOMIC_RELEASE);
+    /* Unconditionally, the worker may be about to sleep with nothing queued */
+    worker_signal(s->worker);
+    return NULL;
+}
+
+/* Process queued large packets of the streams of the worker. Returns whether
+ * there were any, and whether all the streams ended with empty queues. */
+static bool worker_drain(
+    lpin_worker_t *w,
+    bool *all_ended)
+{
+    lpin_t *in = w->in;
+    bool any = false;
+    unsigned i;
+
+    *all_ended = true;
+    for (i = 0; i < in->n_streams; i++) {
+        lpin_stream_t *s = in->streams[i];
+        bool ended;
+        int n;
+
+        if (s->worker != w) {
+            continue;
+        }
+
+        /* Read before the queue, the last push happens before the end */
+        ended = __atomic_load_n(&s->ended, __ATOMIC_ACQUIRE);
+        for (n = 0; n < LPIN_WORKER_BATCH; n++) {
+            lpin_item_t *item = spsc_pop(&s->full);
+
+            if (item == NULL) {
+                break;
+            }
+            item_process(w, s->index, item);
+            spsc_push(&s->free, item);
+            any = true;
+        }
+        if (!ended || spsc_len(&s->full) > 0) {
+            *all_ended = false;
+        }
+    }
+    return any;
+}
+
+static void item_process(
+    lpin_worker_t *w,
+    unsigned stream,
+    const lpin_item_t *item)
+{
+    const lpin_config_t *config = &w->in->config;
+    lpin_packet_t packet;
+    uint64_t start;
+    uint64_t end;
+
+    memcpy(packet.src, item->src, sizeof(packet.src));
+    packet.packet_id = item->packet_id;
+    packet.len = item->len;
+    packet.payload = item->payload;
+
+    if (config->transform != NULL) {
+        size_t out_len = 0;
+        int ret;
+
+        start = now_ns();
+        ret = config->transform(config->ctx, &packet, w->out,
+            config->transform_max_len, &out_len);
+        end = now_ns();
+        __atomic_fetch_add(&w->transform.busy_ns, end - start, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&w->transform.n_bytes, packet.len, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&w->transform.n_packets, 1, __ATOMIC_RELAXED);
+        if (ret < 0) {
+            __atomic_fetch_add(&w->n_transform_errors, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        packet.payload = w->out;
+        packet.len = out_len;
+    }
+
+    start = now_ns();
+    config->sink(config->ctx, stream, &packet);
+    end = now_ns();
+    __atomic_fetch_add(&w->sink.busy_ns, end - start, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&w->sink.n_bytes, packet.len, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&w->sink.n_packets, 1, __ATOMIC_RELAXED);
+}
+
+static void *worker_thread(
+    void *arg)
+{
+    lpin_worker_t *w = (lpin_worker_t *) arg;
+    bool all_ended;
+    uint64_t count;
+
+    for (;;) {
+        if (worker_drain(w, &all_ended)) {
+            continue;
+        }
+        if (all_ended) {
+            break;
+        }
+
+        __atomic_store_n(&w->sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (worker_drain(w, &all_ended) || all_ended) {
+            __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (read(w->event_fd, &count, sizeof(count)) < 0 && errno != EINTR) {
+            P_ERR("%s: eventfd read\n", __func__);
+            break;
+        }
+        __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
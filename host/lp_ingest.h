@@ -0,0 +1,124 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_INGEST_H
+#define LP_INGEST_H
+
+/* Function identifier prefix: lpin_ */
+
+/* Gateway ingest of the large packets received by several roots, each
+ * streaming binary frames (see lp_frame.h) from its UART, or from lp_rxd.
+ *
+ * The stages run concurrently: every stream has a decode thread, reading the
+ * stream and decoding its frames, CRC checked (see lp_frame_decoder.h). Decoded
+ * large packets go through a lock-free single producer, single consumer queue
+ * to one of the worker threads, which runs the transform stage, e.g.
+ * decompression, and the sink. Streams are spread over the workers, so that
+ * the large packets of a stream are sunk in order. Ingest scales over cores
+ * with the number of streams, up to the number of workers.
+ *
+ * A full queue holds back the decode thread of its stream, and the stream is
+ * read no further, until the worker catches up. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lp_frame.h"
+
+#ifndef LPIN_MAX_STREAMS
+#define LPIN_MAX_STREAMS (32)
+#endif
+
+#ifndef LPIN_MAX_WORKERS
+#define LPIN_MAX_WORKERS (16)
+#endif
+
+typedef struct {
+    uint8_t src[LPFR_ADDRESS_SIZE];
+    uint16_t packet_id;
+    size_t len;
+    const uint8_t *payload;
+} lpin_packet_t;
+
+/* Transform stage, e.g. decompression, in a worker thread. Writes the
+ * transformed payload to out, and its length to out_len. Returns 0, or -1 to
+ * drop the large packet. */
+typedef int (*lpin_transform_fn_t)(
+    void *ctx,
+    const lpin_packet_t *packet,
+    uint8_t *out,
+    size_t out_size,
+    size_t *out_len);
+
+/* Sink stage, in a worker thread. The workers call it concurrently, for
+ * different streams. The packet is valid during the call. */
+typedef void (*lpin_sink_fn_t)(
+    void *ctx,
+    unsigned stream,
+    const lpin_packet_t *packet);
+
+typedef struct {
+    unsigned n_workers;
+    unsigned queue_depth; /* large packets per stream, a power of two */
+    lpin_transform_fn_t transform; /* NULL for none */
+    size_t transform_max_len; /* size of the transform output buffer */
+    lpin_sink_fn_t sink;
+    void *ctx;
+} lpin_config_t;
+
+typedef struct {
+    uint64_t n_packets;
+    uint64_t n_bytes; /* in, read for decode */
+    uint64_t busy_ns;
+} lpin_stage_stats_t;
+
+typedef struct {
+    lpin_stage_stats_t decode;
+    lpin_stage_stats_t transform;
+    lpin_stage_stats_t sink;
+    uint64_t n_crc_errors;
+    uint64_t n_malformed;
+    uint64_t n_transform_errors;
+    uint64_t n_stalls; /* decode waits on a full queue */
+    uint32_t backlog; /* large packets queued between decode and transform */
+    unsigned n_streams_open;
+} lpin_stats_t;
+
+typedef struct lpin lpin_t;
+
+/* Returns NULL on error. */
+lpin_t *lpin_create(
+    const lpin_config_t *config);
+
+/* Add a stream to read from, before lpin_start(). The stream ends at end of
+ * file. Returns the stream index, or -1 if there are too many. */
+int lpin_stream_add(
+    lpin_t *in,
+    int fd);
+
+/* Start the threads. Returns 0, or -1 on error. */
+int lpin_start(
+    lpin_t *in);
+
+/* Snapshot of the counters, for reporting while running. */
+void lpin_stats_get(
+    lpin_t *in,
+    lpin_stats_t *stats);
+
+/* Wait for all streams to end, and for their large packets to be sunk. */
+void lpin_wait(
+    lpin_t *in);
+
+/* Stop reading the streams, sink what is decoded already, and wait for it. */
+void lpin_stop(
+    lpin_t *in);
+
+/* Free everything, after lpin_wait() or lpin_stop(). The streams are not
+ * closed. */
+void lpin_destroy(
+    lpin_t *in);
+
+#endif
@@ -0,0 +1,680 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+
+This example is provided as is, without warranty.
+----------------------------------------------------------------------------*/
+
+/* Emulates many sender nodes from one process, to stress a receiver (a Mira
+ * root, or lp_rxd): each sender has a UDP socket of its own, signals large
+ * packets as they arrive, and sends the requested sub-packets at the requested
+ * period, with the messages of lp_wire.h. Senders are started gradually over
+ * the ramp time. Each second, a line reports the number of active senders, the
+ * large packets completed (acknowledged in whole) per second, and percentiles of
+ * the completion latency, from arrival of the packet at the sender to its
+ * final acknowledgement. The totals are printed at the end.
+ *
+ * Usage: lp_loadgen [-d address] [-p port] [-N senders] [-R ramp_s] [-t duration_s]
+ *                   [-s min_bytes[-max_bytes] | -S object_bytes] [-a interval_ms] [-P]
+ *                   [-c pacing_percent] [-l loss_percent]
+ *
+ *  -S  send objects of object_bytes instead of large packets, as consecutive
+ *      large packets of LARGE_PACKET_SEGMENT_MAX_BYTES, each signaled with its
+ *      segment (see lp_wire.h). Completions and latencies are then per object.
+ *  -a  mean time between large packets at each sender, periodic, or with -P
+ *      Poisson arrivals (exponential interval)
+ *  -c  sub-packet period as percentage of the requested one, 100 complies,
+ *      50 sends twice as fast, 0 sends back to back
+ *  -l  percentage of datagrams dropped, in both directions
+ */
+#define _DEFAULT_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lp_wire.h"
+
+// ******************************************************************************
+// Module constants
+// ******************************************************************************
+#define LATENCY_MAX_MS (120000)
+
+/* Signal repetitions, as large_packet_announce() */
+#define SIGNAL_RETRY_MS (1000)
+#define SIGNAL_MAX_TRIES (6)
+
+/* Give up waiting for a request or the final acknowledgement */
+#define WAIT_TIMEOUT_MS (60000)
+
+#define EVENTS_MAX (256)
+
+// ******************************************************************************
+// Module types
+// ******************************************************************************
+typedef enum {
+    SENDER_INACTIVE, /* until started by the ramp */
+    SENDER_IDLE, /* until next arrival */
+    SENDER_SIGNALING,
+    SENDER_SENDING,
+    SENDER_WAITING, /* for the final acknowledgement, or a new request */
+} sender_state_t;
+
+typedef struct {
+    int fd;
+    sender_state_t state;
+    uint64_t deadline_ms;
+    uint64_t arrival_ms;
+
+    uint16_t packet_id;
+    uint8_t n_sub_packets;
+    uint16_t len;
+    uint64_t to_send;
+    uint16_t period_ms;
+    uint8_t session;
+    uint8_t n_signals;
+
+    /* Of the object, with -S */
+    uint16_t segment;
+    uint32_t object_left;
+} sender_t;
+
+/* Latencies in ms, the last bucket holds larger ones */
+typedef struct {
+    uint32_t buckets[LATENCY_MAX_MS + 1];
+    uint32_t n;
+    uint64_t max_ms;
+} histogram_t;
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static volatile sig_atomic_t running = 1;
+
+static struct sockaddr_in6 dst;
+static uint32_t n_senders = 100;
+static uint32_t ramp_s = 10;
+static uint32_t duration_s = 30;
+static uint16_t min_bytes = 1000;
+static uint16_t max_bytes = 1000;
+static uint32_t object_bytes;
+static uint32_t interval_ms = 5000;
+static bool poisson;
+static uint32_t pacing_percent = 100;
+static double loss;
+
+static sender_t *senders;
+static uint8_t payload[LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS
+    * LARGE_PACKET_SUBPACKET_MAX_BYTES];
+
+static histogram_t interval_latency;
+static histogram_t total_latency;
+static uint32_t n_failed;
+static uint32_t n_interval_failed;
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static void stop(
+    int sig);
+
+static uint64_t now_ms(
+    void);
+
+static double random_unit(
+    void);
+
+static uint32_t arrival_interval(
+    void);
+
+static void datagram_send(
+    sender_t *s,
+    const lpc_schema_t *schema,
+    const void *msg);
+
+static void signal_send(
+    sender_t *s);
+
+static void sub_packet_send(
+    sender_t *s);
+
+static void packet_start(
+    sender_t *s,
+    uint64_t now);
+
+static void packet_end(
+    sender_t *s,
+    uint64_t now,
+    bool completed);
+
+static void sender_timeout(
+    sender_t *s,
+    uint64_t now);
+
+static void sender_receive(
+    sender_t *s,
+    uint64_t now);
+
+static void histogram_add(
+    histogram_t *h,
+    uint64_t ms);
+
+static uint32_t histogram_percentile(
+    const histogram_t *h,
+    uint32_t percent);
+
+static void histogram_print(
+    const histogram_t *h);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int main(
+    int argc,
+    char *argv[])
+{
+    const char *address = "::1";
+    uint16_t port = LARGE_PACKET_RX_UDP_PORT;
+    struct epoll_event events[EVENTS_MAX];
+    struct sigaction sa;
+    struct rlimit rl;
+    uint64_t start_ms;
+    uint64_t report_ms;
+    uint64_t end_ms;
+    uint32_t n_active = 0;
+    uint32_t i;
+    int epoll_fd;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:p:N:R:t:s:S:a:Pc:l:")) != -1) {
+        switch (opt) {
+        case 'd':
+            address = optarg;
+            break;
+        case 'p':
+            port = strtoul(optarg, NULL, 10);
+            break;
+        case 'N':
+            n_senders = strtoul(optarg, NULL, 10);
+            break;
+        case 'R':
+            ramp_s = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            duration_s = strtoul(optarg, NULL, 10);
+            break;
+        case 's': {
+            char *end;
+
+            min_bytes = max_bytes = strtoul(optarg, &end, 10);
+            if (*end == '-') {
+                max_bytes = strtoul(end + 1, NULL, 10);
+            }
+            break;
+        }
+        case 'S':
+            object_bytes = strtoul(optarg, NULL, 10);
+            break;
+        case 'a':
+            interval_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            poisson = true;
+            break;
+        case 'c':
+            pacing_percent = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            loss = strtod(optarg, NULL) / 100;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d address] [-p port] [-N senders] [-R ramp_s] "
+                "[-t duration_s] [-s min_bytes[-max_bytes] | -S object_bytes] "
+                "[-a interval_ms] [-P] "
+                "[-c pacing_percent] [-l loss_percent]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (min_bytes == 0 || max_bytes < min_bytes || max_bytes > sizeof(payload)) {
+        fprintf(stderr, "Sizes from 1 to %zu bytes\n", sizeof(payload));
+        return 1;
+    }
+    if (object_bytes > 0
+        && (object_bytes - 1) / LARGE_PACKET_SEGMENT_MAX_BYTES > UINT16_MAX) {
+        fprintf(stderr, "Objects of at most %u segments\n", UINT16_MAX + 1);
+        return 1;
+    }
+    memset(&dst, 0, sizeof(dst));
+    dst.sin6_family = AF_INET6;
+    dst.sin6_port = htons(port);
+    if (inet_pton(AF_INET6, address, &dst.sin6_addr) != 1) {
+        fprintf(stderr, "%s: not an IPv6 address\n", address);
+        return 1;
+    }
+
+    /* A socket per sender */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    srandom(time(NULL) ^ getpid());
+    for (i = 0; i < sizeof(payload); i++) {
+        payload[i] = i;
+    }
+
+    epoll_fd = epoll_create1(0);
+    senders = calloc(n_senders, sizeof(*senders));
+    if (epoll_fd < 0 || senders == NULL) {
+        perror("init");
+        return 1;
+    }
+    for (i = 0; i < n_senders; i++) {
+        struct epoll_event ev = {
+            .events = EPOLLIN,
+            .data.u32 = i,
+        };
+
+        senders[i].fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (senders[i].fd < 0
+            || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, senders[i].fd, &ev) < 0) {
+            perror("socket");
+            return 1;
+        }
+        senders[i].packet_id = random();
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    start_ms = now_ms();
+    report_ms = start_ms + 1000;
+    end_ms = start_ms + (uint64_t) duration_s * 1000;
+
+    while (running) {
+        uint64_t now = now_ms();
+        uint64_t next = report_ms;
+        int n;
+
+        if (now >= end_ms) {
+            break;
+        }
+
+        /* Ramp */
+        while (n_active < n_senders
+            && now >= start_ms + (uint64_t) ramp_s * 1000 * n_active / n_senders) {
+            sender_t *s = &senders[n_active++];
+
+            s->state = SENDER_IDLE;
+            s->arrival_ms = now + random() % (interval_ms + 1);
+            s->deadline_ms = s->arrival_ms;
+        }
+        if (n_active < n_senders) {
+            uint64_t ramp_next = start_ms
+                + (uint64_t) ramp_s * 1000 * n_active / n_senders;
+
+            next = ramp_next < next ? ramp_next : next;
+        }
+
+        /* Timers, by a scan: the event rate, not the number of senders,
+         * bounds the load of the emulation */
+        for (i = 0; i < n_active; i++) {
+            if (senders[i].deadline_ms <= now) {
+                sender_timeout(&senders[i], now);
+            }
+            if (senders[i].deadline_ms < next) {
+                next = senders[i].deadline_ms;
+            }
+        }
+
+        if (now >= report_ms) {
+            histogram_t *h = &interval_latency;
+
+            printf("%5llu s %6u senders %7u pkt/s %5u failed  "
+                "latency ms p50 %u p90 %u p99 %u max %llu\n",
+                (unsigned long long) (now - start_ms) / 1000,
+                n_active,
+                h->n,
+                n_interval_failed,
+                histogram_percentile(h, 50),
+                histogram_percentile(h, 90),
+                histogram_percentile(h, 99),
+                (unsigned long long) h->max_ms);
+            fflush(stdout);
+            memset(h, 0, sizeof(*h));
+            n_interval_failed = 0;
+            report_ms += 1000;
+            continue;
+        }
+
+        n = epoll_wait(epoll_fd, events, EVENTS_MAX,
+            next > now ? (int) (next - now) : 0);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        now = now_ms();
+        for (int e = 0; e < n; e++) {
+            sender_receive(&senders[events[e].data.u32], now);
+        }
+    }
+
+    printf("Total, %u senders over %u s: %u packets, %.1f pkt/s, %u failed\n",
+        n_active,
+        (unsigned) ((now_ms() - start_ms) / 1000),
+        total_latency.n,
+        total_latency.n * 1000.0 / (now_ms() - start_ms),
+        n_failed);
+    histogram_print(&total_latency);
+
+    for (i = 0; i < n_senders; i++) {
+        close(senders[i].fd);
+    }
+    free(senders);
+    close(epoll_fd);
+    return 0;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static void stop(
+    int sig)
+{
+    (void) sig;
+    running = 0;
+}
+
+static uint64_t now_ms(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static double random_unit(
+    void)
+{
+    return (random() + 0.5) / ((double) RAND_MAX + 1);
+}
+
+static uint32_t arrival_interval(
+    void)
+{
+    if (poisson) {
+        return -log(random_unit()) * interval_ms;
+    }
+    return interval_ms;
+}
+
+static void datagram_send(
+    sender_t *s,
+    const lpc_schema_t *schema,
+    const void *msg)
+{
+    uint8_t buffer[LARGE_PACKET_SUBPACKET_MAX_BYTES + 64];
+    int len;
+
+    if (random_unit() < loss) {
+        return;
+    }
+    len = lpc_encode(schema, msg, buffer, sizeof(buffer));
+    if (len < 0) {
+        return;
+    }
+    /* A full socket buffer is a loss as any other */
+    sendto(s->fd, buffer, len, 0, (const struct sockaddr *) &dst, sizeof(dst));
+}
+
+static void signal_send(
+    sender_t *s)
+{
+    lpsig_msg_t msg = {
+        .packet_id = s->packet_id,
+        .n_sub_packets = s->n_sub_packets,
+        .flags = 0,
+        .segment = s->segment,
+    };
+
+    datagram_send(s,
+        s->segment == 0 ? &lpsig_schema : &lpsig_segment_schema,
+        &msg);
+    s->n_signals++;
+}
+
+static void sub_packet_send(
+    sender_t *s)
+{
+    uint8_t index = __builtin_ctzll(s->to_send);
+    uint16_t offset = index * LARGE_PACKET_SUBPACKET_MAX_BYTES;
+    lpsp_msg_t msg = {
+        .packet_id = s->packet_id,
+        .sub_packet_index = index,
+        .n_sub_packets = s->n_sub_packets,
+        .payload_len = s->len - offset < LARGE_PACKET_SUBPACKET_MAX_BYTES
+            ? s->len - offset
+            : LARGE_PACKET_SUBPACKET_MAX_BYTES,
+        .payload = payload + offset,
+    };
+
+    if (s->session != LPREQ_NO_SESSION) {
+        lpsp_compact_msg_t compact = {
+            .session = s->session,
+            .sub_packet_index = index,
+            .payload_len = msg.payload_len,
+            .payload = msg.payload,
+        };
+
+        datagram_send(s, &lpsp_compact_schema, &compact);
+    } else {
+        datagram_send(s, &lpsp_schema, &msg);
+    }
+    s->to_send &= ~((uint64_t) 1 << index);
+}
+
+static void packet_start(
+    sender_t *s,
+    uint64_t now)
+{
+    s->packet_id++;
+    if (object_bytes > 0) {
+        s->len = s->object_left < LARGE_PACKET_SEGMENT_MAX_BYTES
+            ? s->object_left
+            : LARGE_PACKET_SEGMENT_MAX_BYTES;
+    } else {
+        s->len = min_bytes + random() % (max_bytes - min_bytes + 1);
+    }
+    s->n_sub_packets = (s->len + LARGE_PACKET_SUBPACKET_MAX_BYTES - 1)
+        / LARGE_PACKET_SUBPACKET_MAX_BYTES;
+    s->to_send = 0;
+    s->session = LPREQ_NO_SESSION;
+    s->n_signals = 0;
+
+    signal_send(s);
+    s->state = SENDER_SIGNALING;
+    s->deadline_ms = now + SIGNAL_RETRY_MS;
+}
+
+static void packet_end(
+    sender_t *s,
+    uint64_t now,
+    bool completed)
+{
+    if (completed && s->object_left > s->len) {
+        /* Next segment of the object, at once */
+        s->object_left -= s->len;
+        s->segment++;
+        packet_start(s, now);
+        return;
+    }
+
+    if (completed) {
+        histogram_add(&interval_latency, now - s->arrival_ms);
+        histogram_add(&total_latency, now - s->arrival_ms);
+    } else {
+        n_failed++;
+        n_interval_failed++;
+    }
+
+    /* Open loop: a late packet starts at once, and its latency includes the
+     * wait */
+    s->arrival_ms += arrival_interval();
+    s->state = SENDER_IDLE;
+    s->deadline_ms = s->arrival_ms;
+}
+
+static void sender_timeout(
+    sender_t *s,
+    uint64_t now)
+{
+    switch (s->state) {
+    case SENDER_IDLE:
+        s->segment = 0;
+        s->object_left = object_bytes;
+        packet_start(s, now);
+        break;
+    case SENDER_SIGNALING:
+        if (s->n_signals >= SIGNAL_MAX_TRIES) {
+            packet_end(s, now, false);
+            break;
+        }
+        signal_send(s);
+        s->deadline_ms = now + SIGNAL_RETRY_MS;
+        break;
+    case SENDER_SENDING:
+        sub_packet_send(s);
+        if (s->to_send == 0) {
+            s->state = SENDER_WAITING;
+            s->deadline_ms = now + WAIT_TIMEOUT_MS;
+        } else {
+            s->deadline_ms = now + (uint64_t) s->period_ms * pacing_percent / 100;
+        }
+        break;
+    case SENDER_WAITING:
+        packet_end(s, now, false);
+        break;
+    default:
+        break;
+    }
+}
+
+static void sender_receive(
+    sender_t *s,
+    uint64_t now)
+{
+    uint8_t buffer[256];
+    ssize_t len;
+
+    while ((len = recv(s->fd, buffer, sizeof(buffer), 0)) >= 0) {
+        if (random_unit() < loss
+            || s->state == SENDER_IDLE
+            || s->state == SENDER_INACTIVE) {
+            continue;
+        }
+
+        if (lpc_match(&lpreq_schema, buffer, len)
+            || lpc_match(&lpreq_session_schema, buffer, len)) {
+            lpreq_msg_t msg = { .session = LPREQ_NO_SESSION };
+
+            if ((lpc_decode(&lpreq_schema, &msg, buffer, len) < 0
+                 && lpc_decode(&lpreq_session_schema, &msg, buffer, len) < 0)
+                || msg.packet_id != s->packet_id) {
+                continue;
+            }
+            s->session = msg.session;
+            if (s->state != SENDER_SENDING) {
+                s->state = SENDER_SENDING;
+                s->deadline_ms = now;
+            }
+            s->to_send |= msg.mask
+                & (((uint64_t) 2 << (s->n_sub_packets - 1)) - 1);
+            s->period_ms = msg.period_ms;
+            if (s->to_send == 0) {
+                s->state = SENDER_WAITING;
+                s->deadline_ms = now + WAIT_TIMEOUT_MS;
+            }
+        } else if (lpc_match(&lpack_schema, buffer, len)) {
+            lpack_msg_t msg;
+
+            if (lpc_decode(&lpack_schema, &msg, buffer, len) < 0
+                || msg.packet_id != s->packet_id) {
+                continue;
+            }
+            if (msg.mask == (((uint64_t) 2 << (s->n_sub_packets - 1)) - 1)) {
+                packet_end(s, now, true);
+            } else if (s->state != SENDER_SENDING) {
+                /* Signal received, possibly pipelined, or progress: the
+                 * receiver requests what is missing */
+                s->state = SENDER_WAITING;
+                s->deadline_ms = now + WAIT_TIMEOUT_MS;
+            }
+        } else if (lpc_match(&lpreq_cancel_schema, buffer, len)) {
+            lpreq_cancel_msg_t msg;
+
+            if (lpc_decode(&lpreq_cancel_schema, &msg, buffer, len) < 0
+                || msg.packet_id != s->packet_id) {
+                continue;
+            }
+            packet_end(s, now, false);
+        }
+    }
+}
+
+static void histogram_add(
+    histogram_t *h,
+    uint64_t ms)
+{
+    h->buckets[ms < LATENCY_MAX_MS ? ms : LATENCY_MAX_MS]++;
+    h->n++;
+    if (ms > h->max_ms) {
+        h->max_ms = ms;
+    }
+}
+
+static uint32_t histogram_percentile(
+    const histogram_t *h,
+    uint32_t percent)
+{
+    uint64_t rank = ((uint64_t) h->n * percent + 99) / 100;
+    uint64_t count = 0;
+    uint32_t ms;
+
+    if (h->n == 0) {
+        return 0;
+    }
+    for (ms = 0; ms < LATENCY_MAX_MS; ms++) {
+        count += h->buckets[ms];
+        if (count >= rank) {
+            break;
+        }
+    }
+    return ms;
+}
+
+static void histogram_print(
+    const histogram_t *h)
+{
+    static const uint32_t percents[] = { 10, 50, 90, 99, 100 };
+
+    printf("Latency ms:");
+    for (size_t i = 0; i < sizeof(percents) / sizeof(percents[0]); i++) {
+        printf(" p%u %u", percents[i], histogram_percentile(h, percents[i]));
+    }
+    printf(", max %llu\n", (unsigned long long) h->max_ms);
+}
@@ -0,0 +1,937 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lp_prof.h"
+#include "lp_rx.h"
+#include "lp_rxrules.h"
+#include "lp_wire.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+// ******************************************************************************
+// Module types
+// ******************************************************************************
+typedef enum {
+    /* Keeps a partial reception for resuming, until the session expires */
+    LPRX_STATE_IDLE,
+    LPRX_STATE_RECEIVING,
+} lprx_state_t;
+
+typedef struct lprx_session {
+    struct sockaddr_in6 peer;
+    struct lprx_session *hash_next;
+    lprx_state_t state;
+
+    uint16_t packet_id;
+    uint8_t n_sub_packets;
+    uint16_t segment;
+    uint64_t mask;
+    uint16_t period_ms;
+    uint16_t len;
+    uint8_t *payload; /* n_sub_packets whole sub-packets */
+    uint8_t n_requests_left;
+    uint8_t n_until_report;
+    /* Of the requests, for compact sub-packets */
+    uint8_t handle;
+
+    /* Signals received during the reception, requested in turn once it
+     * ends */
+    lpsig_msg_t pending[LPRX_MAX_PENDING_SIGNALS];
+    uint8_t n_pending;
+
+    uint64_t deadline_ms;
+    uint32_t heap_index;
+} lprx_session_t;
+
+struct lprx {
+    lprx_config_t config;
+    int sock_fd;
+    int timer_fd;
+    int epoll_fd;
+
+    /* Sessions by peer, the number of buckets is a power of two */
+    lprx_session_t **buckets;
+    uint32_t bucket_mask;
+
+    /* Min-heap of session timers, on deadline_ms */
+    lprx_session_t **heap;
+    uint32_t heap_len;
+
+    lprx_stats_t stats;
+};
+
+// ******************************************************************************
+// Module constants
+// ******************************************************************************
+#define LPRX_NOT_IN_HEAP (UINT32_MAX)
+
+/* Datagrams read from the socket at most per dispatch, not to starve timers */
+#define LPRX_MAX_DATAGRAMS_PER_DISPATCH (64)
+
+/* Large enough for a sub-packet, the largest message */
+#define LPRX_DATAGRAM_MAX_BYTES (LARGE_PACKET_SUBPACKET_MAX_BYTES + 64)
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static uint64_t now_ms(
+    void);
+
+static uint32_t peer_hash(
+    const struct sockaddr_in6 *peer);
+
+static lprx_session_t *session_find(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer);
+
+static lprx_session_t *session_create(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer);
+
+static void session_free(
+    lprx_t *rx,
+    lprx_session_t *s);
+
+static void heap_swap(
+    lprx_t *rx,
+    uint32_t a,
+    uint32_t b);
+
+static void heap_up(
+    lprx_t *rx,
+    uint32_t i);
+
+static void heap_down(
+    lprx_t *rx,
+    uint32_t i);
+
+static void heap_remove(
+    lprx_t *rx,
+    lprx_session_t *s);
+
+static void timer_set(
+    lprx_t *rx,
+    lprx_session_t *s,
+    uint64_t delay_ms);
+
+static int timer_fd_arm(
+    lprx_t *rx);
+
+static void timers_run(
+    lprx_t *rx);
+
+static void message_send(
+    lprx_t *rx,
+    const lprx_session_t *s,
+    const lpc_schema_t *schema,
+    const void *msg);
+
+static void missing_request(
+    lprx_t *rx,
+    lprx_session_t *s);
+
+static void progress_report(
+    lprx_t *rx,
+    const lprx_session_t *s);
+
+static void pending_request(
+    lprx_t *rx,
+    const lprx_session_t *s);
+
+static void reception_start(
+    lprx_t *rx,
+    lprx_session_t *s,
+    const lpsig_msg_t *signal,
+    bool requested);
+
+static void reception_end(
+    lprx_t *rx,
+    lprx_session_t *s);
+
+static bool signal_handle(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer,
+    const lpsig_msg_t *signal);
+
+static void sub_packet_handle(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer,
+    const lpsp_msg_t *msg);
+
+static void datagram_handle(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer,
+    const uint8_t *buffer,
+    uint16_t len);
+
+static void timeout_handle(
+    lprx_t *rx,
+    lprx_session_t *s);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+lprx_t *lprx_open(
+    const lprx_config_t *config)
+{
+    lprx_t *rx = calloc(1, sizeof(*rx));
+    struct sockaddr_in6 addr;
+    struct epoll_event ev;
+    uint32_t n_buckets = 1;
+    int err;
+
+    if (rx == NULL) {
+        return NULL;
+    }
+    lpprof_init();
+    rx->config = *config;
+    rx->sock_fd = -1;
+    rx->timer_fd = -1;
+    rx->epoll_fd = -1;
+
+    while (n_buckets < config->max_sessions) {
+        n_buckets <<= 1;
+    }
+    rx->bucket_mask = n_buckets - 1;
+    rx->buckets = calloc(n_buckets, sizeof(*rx->buckets));
+    rx->heap = calloc(config->max_sessions ? config->max_sessions : 1,
+        sizeof(*rx->heap));
+    if (rx->buckets == NULL || rx->heap == NULL) {
+        goto fail;
+    }
+
+    rx->sock_fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (rx->sock_fd < 0) {
+        P_ERR("%s: socket\n", __func__);
+        goto fail;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(config->port);
+    if (bind(rx->sock_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        P_ERR("%s: bind port %u\n", __func__, config->port);
+        goto fail;
+    }
+
+    rx->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    rx->epoll_fd = epoll_create1(0);
+    if (rx->timer_fd < 0 || rx->epoll_fd < 0) {
+        P_ERR("%s: timerfd/epoll\n", __func__);
+        goto fail;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = rx->sock_fd;
+    if (epoll_ctl(rx->epoll_fd, EPOLL_CTL_ADD, rx->sock_fd, &ev) < 0) {
+        goto fail;
+    }
+    ev.data.fd = rx->timer_fd;
+    if (epoll_ctl(rx->epoll_fd, EPOLL_CTL_ADD, rx->timer_fd, &ev) < 0) {
+        goto fail;
+    }
+
+    return rx;
+
+fail:
+    err = errno;
+    lprx_close(rx);
+    errno = err;
+    return NULL;
+}
+
+int lprx_fd(
+    const lprx_t *rx)
+{
+    return rx->epoll_fd;
+}
+
+int lprx_dispatch(
+    lprx_t *rx,
+    int timeout_ms)
+{
+    struct epoll_event events[2];
+    uint8_t buffer[LPRX_DATAGRAM_MAX_BYTES];
+    struct sockaddr_in6 peer;
+    socklen_t peer_len;
+    uint64_t expirations;
+    ssize_t len;
+    int n;
+    int i;
+    int j;
+
+    n = epoll_wait(rx->epoll_fd, events, 2, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (events[i].data.fd == rx->timer_fd) {
+            /* Drained only, the heap tells what expired */
+            if (read(rx->timer_fd, &expirations, sizeof(expirations)) < 0
+                && errno != EAGAIN) {
+                return -1;
+            }
+            continue;
+        }
+
+        for (j = 0; j < LPRX_MAX_DATAGRAMS_PER_DISPATCH; j++) {
+            peer_len = sizeof(peer);
+            len = recvfrom(rx->sock_fd, buffer, sizeof(buffer), 0,
+                (struct sockaddr *) &peer, &peer_len);
+            if (len < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                return -1;
+            }
+            if (peer_len != sizeof(peer) || peer.sin6_family != AF_INET6) {
+                continue;
+            }
+            datagram_handle(rx, &peer, buffer, (uint16_t) len);
+        }
+    }
+
+    timers_run(rx);
+    return timer_fd_arm(rx);
+}
+
+void lprx_stats_get(
+    const lprx_t *rx,
+    lprx_stats_t *stats)
+{
+    *stats = rx->stats;
+}
+
+void lprx_close(
+    lprx_t *rx)
+{
+    lprx_session_t *s;
+    uint32_t i;
+
+    if (rx == NULL) {
+        return;
+    }
+
+    if (rx->buckets != NULL) {
+        for (i = 0; i <= rx->bucket_mask; i++) {
+            while ((s = rx->buckets[i]) != NULL) {
+                rx->buckets[i] = s->hash_next;
+                free(s->payload);
+                free(s);
+            }
+        }
+    }
+    free(rx->buckets);
+    free(rx->heap);
+
+    if (rx->epoll_fd >= 0) {
+        close(rx->epoll_fd);
+    }
+    if (rx->timer_fd >= 0) {
+        close(rx->timer_fd);
+    }
+    if (rx->sock_fd >= 0) {
+        close(rx->sock_fd);
+    }
+    free(rx);
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static uint64_t now_ms(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t peer_hash(
+    const struct sockaddr_in6 *peer)
+{
+    /* FNV-1a, on address and port */
+    const uint8_t *addr = peer->sin6_addr.s6_addr;
+    uint32_t h = 2166136261u;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        h = (h ^ addr[i]) * 16777619u;
+    }
+    h = (h ^ (peer->sin6_port & 0xff)) * 16777619u;
+    h = (h ^ (peer->sin6_port >> 8)) * 16777619u;
+    return h;
+}
+
+static lprx_session_t *session_find(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer)
+{
+    lprx_session_t *s = rx->buckets[peer_hash(peer) & rx->bucket_mask];
+
+    while (s != NULL) {
+        if (s->peer.sin6_port == peer->sin6_port
+            && memcmp(&s->peer.sin6_addr, &peer->sin6_addr,
+                sizeof(peer->sin6_addr)) == 0) {
+            return s;
+        }
+        s = s->hash_next;
+    }
+    return NULL;
+}
+
+static lprx_session_t *session_create(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer)
+{
+    lprx_session_t **bucket;
+    lprx_session_t *s;
+
+    if (rx->stats.n_sessions >= rx->config.max_sessions) {
+        return NULL;
+    }
+    s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return NULL;
+    }
+
+    s->peer = *peer;
+    s->state = LPRX_STATE_IDLE;
+    s->heap_index = LPRX_NOT_IN_HEAP;
+
+    bucket = &rx->buckets[peer_hash(peer) & rx->bucket_mask];
+    s->hash_next = *bucket;
+    *bucket = s;
+    rx->stats.n_sessions++;
+    return s;
+}
+
+static void session_free(
+    lprx_t *rx,
+    lprx_session_t *s)
+{
+    lprx_session_t **p = &rx->buckets[peer_hash(&s->peer) & rx->bucket_mask];
+
+    while (*p != s) {
+        p = &(*p)->hash_next;
+    }
+    *p = s->hash_next;
+
+    heap_remove(rx, s);
+    free(s->payload);
+    free(s);
+    rx->stats.n_sessions--;
+}
+
+static void heap_swap(
+    lprx_t *rx,
+    uint32_t a,
+    uint32_t b)
+{
+    lprx_session_t *tmp = rx->heap[a];
+
+    rx->heap[a] = rx->heap[b];
+    rx->heap[b] = tmp;
+    rx->heap[a]->heap_index = a;
+    rx->heap[b]->heap_index = b;
+}
+
+static void heap_up(
+    lprx_t *rx,
+    uint32_t i)
+{
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+
+        if (rx->heap[parent]->deadline_ms <= rx->heap[i]->deadline_ms) {
+            break;
+        }
+        heap_swap(rx, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(
+    lprx_t *rx,
+    uint32_t i)
+{
+    for (;;) {
+        uint32_t smallest = i;
+        uint32_t child = 2 * i + 1;
+
+        if (child < rx->heap_len
+            && rx->heap[child]->deadline_ms < rx->heap[smallest]->deadline_ms) {
+            smallest = child;
+        }
+        child++;
+        if (child < rx->heap_len
+            && rx->heap[child]->deadline_ms < rx->heap[smallest]->deadline_ms) {
+            smallest = child;
+        }
+        if (smallest == i) {
+            break;
+        }
+        heap_swap(rx, i, smallest);
+        i = smallest;
+    }
+}
+
+static void heap_remove(
+    lprx_t *rx,
+    lprx_session_t *s)
+{
+    uint32_t i = s->heap_index;
+
+    if (i == LPRX_NOT_IN_HEAP) {
+        return;
+    }
+    s->heap_index = LPRX_NOT_IN_HEAP;
+
+    rx->heap_len--;
+    if (i == rx->heap_len) {
+        return;
+    }
+    rx->heap[i] = rx->heap[rx->heap_len];
+    rx->heap[i]->heap_index = i;
+    heap_up(rx, i);
+    heap_down(rx, rx->heap[i]->heap_index);
+}
+
+static void timer_set(
+    lprx_t *rx,
+    lprx_session_t *s,
+    uint64_t delay_ms)
+{
+    heap_remove(rx, s);
+
+    s->deadline_ms = now_ms() + delay_ms;
+    s->heap_index = rx->heap_len;
+    rx->heap[rx->heap_len++] = s;
+    heap_up(rx, s->heap_index);
+}
+
+static int timer_fd_arm(
+    lprx_t *rx)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (rx->heap_len > 0) {
+        uint64_t deadline = rx->heap[0]->deadline_ms;
+
+        its.it_value.tv_sec = deadline / 1000;
+        its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            /* Zero would disarm the timer */
+            its.it_value.tv_nsec = 1;
+        }
+    }
+    return timerfd_settime(rx->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void timers_run(
+    lprx_t *rx)
+{
+    uint64_t now = now_ms();
+
+    while (rx->heap_len > 0 && rx->heap[0]->deadline_ms <= now) {
+        lprx_session_t *s = rx->heap[0];
+
+        heap_remove(rx, s);
+        timeout_handle(rx, s);
+    }
+}
+
+static void message_send(
+    lprx_t *rx,
+    const lprx_session_t *s,
+    const lpc_schema_t *schema,
+    const void *msg)
+{
+    uint8_t buffer[64];
+    int len = lpc_encode(schema, msg, buffer, sizeof(buffer));
+
+    if (len < 0) {
+        P_ERR("%s: encode\n", __func__);
+        return;
+    }
+    if (sendto(rx->sock_fd, buffer, len, 0,
+            (const struct sockaddr *) &s->peer, sizeof(s->peer)) < 0) {
+        /* Lost as over the radio, recovered by time-outs */
+        P_DEBUG("%s: sendto: %s\n", __func__, strerror(errno));
+    }
+}
+
+static void missing_request(
+    lprx_t *rx,
+    lprx_session_t *s)
+{
+    lpreq_msg_t msg = {
+        .packet_id = s->packet_id,
+        .mask = lprr_whole_mask(s->n_sub_packets) & ~s->mask,
+        .period_ms = s->period_ms,
+        .session = s->handle,
+    };
+
+    message_send(rx, s, &lpreq_session_schema, &msg);
+}
+
+static void progress_report(
+    lprx_t *rx,
+    const lprx_session_t *s)
+{
+    lpack_msg_t msg = {
+        .packet_id = s->packet_id,
+        .mask = s->mask,
+    };
+
+    message_send(rx, s, &lpack_schema, &msg);
+}
+
+/* Request all pending large packets, in one batch request */
+static void pending_request(
+    lprx_t *rx,
+    const lprx_session_t *s)
+{
+    lpreq_batch_msg_t msg = {
+        .period_ms = rx->config.period_ms,
+        .n_entries = s->n_pending,
+    };
+    uint8_t i;
+
+    for (i = 0; i < s->n_pending; i++) {
+        msg.entries[i] = (lpreq_entry_t) {
+            .packet_id = s->pending[i].packet_id,
+            .sub_packet_mask = lprr_whole_mask(s->pending[i].n_sub_packets),
+        };
+    }
+
+    message_send(rx, s, &lpreq_batch_schema, &msg);
+}
+
+/* Start receiving the signaled large packet. requested if the sender was
+ * asked for it already, with the pending large packets. */
+static void reception_start(
+    lprx_t *rx,
+    lprx_session_t *s,
+    const lpsig_msg_t *signal,
+    bool requested)
+{
+    bool push = signal->flags & LPSIG_FLAG_PUSH;
+    bool subscribed = signal->flags & LPSIG_FLAG_SUBSCRIBED;
+    bool resume = s->payload != NULL
+        && s->packet_id == signal->packet_id
+        && s->n_sub_packets == signal->n_sub_packets
+        && s->segment == signal->segment;
+
+    if (resume) {
+        if (s->state == LPRX_STATE_IDLE) {
+            rx->stats.n_resumed++;
+        }
+    } else {
+        uint8_t *payload = realloc(s->payload,
+            (size_t) signal->n_sub_packets * LARGE_PACKET_SUBPACKET_MAX_BYTES);
+
+        if (payload == NULL) {
+            P_ERR("%s: no memory\n", __func__);
+            return;
+        }
+        s->payload = payload;
+        s->packet_id = signal->packet_id;
+        s->n_sub_packets = signal->n_sub_packets;
+        s->segment = signal->segment;
+        s->mask = 0;
+        s->len = 0;
+        /* Compact sub-packets of earlier requests are late */
+        if (++s->handle == LPREQ_NO_SESSION) {
+            s->handle++;
+        }
+    }
+
+    s->state = LPRX_STATE_RECEIVING;
+    s->period_ms = push && !subscribed
+        ? LARGE_PACKET_PUSH_PERIOD_MS
+        : rx->config.period_ms;
+    s->n_requests_left = LPRR_MAX_RETRANSMISSION_REQUESTS;
+    s->n_until_report = LPRR_PROGRESS_REPORT_INTERVAL;
+
+    if (!push && !requested) {
+        /* All sub-packets, or those missing from before */
+        missing_request(rx, s);
+    }
+    if (!subscribed && rx->config.subscription_lifetime_s > 0) {
+        lpsub_msg_t msg = {
+            .period_ms = rx->config.period_ms,
+            .lifetime_s = rx->config.subscription_lifetime_s,
+        };
+
+        message_send(rx, s, &lpsub_schema, &msg);
+    }
+
+    timer_set(rx, s, lprr_timeout_ms(s->period_ms, random()));
+}
+
+static void reception_end(
+    lprx_t *rx,
+    lprx_session_t *s)
+{
+    s->state = LPRX_STATE_IDLE;
+    timer_set(rx, s, (uint64_t) LPRX_SESSION_TIMEOUT_S * 1000);
+
+    if (s->n_pending > 0) {
+        lpsig_msg_t next = s->pending[0];
+
+        s->n_pending--;
+        memmove(&s->pending[0], &s->pending[1],
+            s->n_pending * sizeof(s->pending[0]));
+        reception_start(rx, s, &next, true);
+    }
+}
+
+/* Returns true if the signal is pending, to be answered with
+ * pending_request() */
+static bool signal_handle(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer,
+    const lpsig_msg_t *signal)
+{
+    lprx_session_t *s;
+
+    if (!lprr_signal_valid(signal->n_sub_packets)) {
+        rx->stats.n_malformed++;
+        return false;
+    }
+
+    s = session_find(rx, peer);
+    if (s == NULL) {
+        s = session_create(rx, peer);
+        if (s == NULL) {
+            rx->stats.n_rejected++;
+            return false;
+        }
+    }
+
+    if (s->state == LPRX_STATE_IDLE
+        && s->payload == NULL
+        && s->packet_id == signal->packet_id
+        && s->n_sub_packets == signal->n_sub_packets
+        && s->mask == lprr_whole_mask(signal->n_sub_packets)) {
+        /* Received already, the final report was lost */
+        progress_report(rx, s);
+        return false;
+    }
+
+    if (s->state == LPRX_STATE_RECEIVING && s->packet_id != signal->packet_id) {
+        if (!(signal->flags & LPSIG_FLAG_PUSH)) {
+            /* Pipelined behind the ongoing transfer. The request for the
+             * pending large packets tells the sender that the signal arrived,
+             * once it is queued. */
+            uint8_t i;
+
+            for (i = 0; i < s->n_pending; i++) {
+                if (s->pending[i].packet_id == signal->packet_id) {
+                    /* Repeated, the request was lost */
+                    break;
+                }
+            }
+            if (i == s->n_pending) {
+                if (s->n_pending == LPRX_MAX_PENDING_SIGNALS) {
+                    /* Signaled again later */
+                    return false;
+                }
+                s->n_pending++;
+            }
+            s->pending[i] = *signal;
+            return true;
+        }
+
+        /* Pushed packets do not wait, the ongoing one is given up */
+        lpreq_cancel_msg_t msg = {
+            .packet_id = s->packet_id,
+        };
+
+        message_send(rx, s, &lpreq_cancel_schema, &msg);
+        rx->stats.n_aborted++;
+    }
+
+    reception_start(rx, s, signal, false);
+    return false;
+}
+
+static void sub_packet_handle(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer,
+    const lpsp_msg_t *msg)
+{
+    lprx_session_t *s = session_find(rx, peer);
+    uint64_t bit;
+
+    if (s == NULL
+        || s->state != LPRX_STATE_RECEIVING
+        || msg->packet_id != s->packet_id) {
+        return;
+    }
+    if (!lprr_sub_packet_valid(
+            s->n_sub_packets,
+            msg->n_sub_packets,
+            msg->sub_packet_index,
+            msg->payload_len)) {
+        rx->stats.n_malformed++;
+        return;
+    }
+
+    timer_set(rx, s, lprr_timeout_ms(s->period_ms, random()));
+
+    bit = (uint64_t) 1 << msg->sub_packet_index;
+    if (s->mask & bit) {
+        return;
+    }
+    LPPROF_START(LPPROF_REASSEMBLY_COPY);
+    memcpy(s->payload
+        + (size_t) msg->sub_packet_index * LARGE_PACKET_SUBPACKET_MAX_BYTES,
+        msg->payload, msg->payload_len);
+    LPPROF_STOP(LPPROF_REASSEMBLY_COPY);
+    s->len += msg->payload_len;
+    s->mask |= bit;
+
+    if (s->mask == lprr_whole_mask(s->n_sub_packets)) {
+        lprx_packet_t packet = {
+            .src = s->peer,
+            .packet_id = s->packet_id,
+            .segment = s->segment,
+            .payload = s->payload,
+            .len = s->len,
+        };
+
+        progress_report(rx, s);
+        rx->stats.n_packets++;
+        if (rx->config.on_packet != NULL) {
+            rx->config.on_packet(rx->config.ctx, &packet);
+        }
+
+        /* Nothing to resume */
+        free(s->payload);
+        s->payload = NULL;
+        reception_end(rx, s);
+    } else if (--s->n_until_report == 0) {
+        progress_report(rx, s);
+        s->n_until_report = LPRR_PROGRESS_REPORT_INTERVAL;
+    }
+}
+
+static void datagram_handle(
+    lprx_t *rx,
+    const struct sockaddr_in6 *peer,
+    const uint8_t *buffer,
+    uint16_t len)
+{
+    if (lpc_match(&lpsp_schema, buffer, len)) {
+        lpsp_msg_t msg;
+
+        LPPROF_START(LPPROF_LPSP_UNPACK);
+        if (lpc_decode(&lpsp_schema, &msg, buffer, len) < 0) {
+            rx->stats.n_malformed++;
+            return;
+        }
+        LPPROF_STOP(LPPROF_LPSP_UNPACK);
+        sub_packet_handle(rx, peer, &msg);
+    } else if (lpc_match(&lpsp_compact_schema, buffer, len)) {
+        lpsp_compact_msg_t compact;
+        lprx_session_t *s = session_find(rx, peer);
+        lpsp_msg_t msg;
+
+        LPPROF_START(LPPROF_LPSP_UNPACK);
+        if (lpc_decode(&lpsp_compact_schema, &compact, buffer, len) < 0) {
+            rx->stats.n_malformed++;
+            return;
+        }
+        LPPROF_STOP(LPPROF_LPSP_UNPACK);
+        if (s == NULL || compact.session != s->handle) {
+            return;
+        }
+        msg = (lpsp_msg_t) {
+            .packet_id = s->packet_id,
+            .sub_packet_index = compact.sub_packet_index,
+            .n_sub_packets = s->n_sub_packets,
+            .payload_len = compact.payload_len,
+            .payload = compact.payload,
+        };
+        sub_packet_handle(rx, peer, &msg);
+    } else if (lpc_match(&lpsig_schema, buffer, len)
+               || lpc_match(&lpsig_segment_schema, buffer, len)) {
+        lpsig_msg_t msg = { .segment = 0 };
+
+        LPPROF_START(LPPROF_LPSIG_UNPACK);
+        if (lpc_decode(&lpsig_schema, &msg, buffer, len) < 0
+            && lpc_decode(&lpsig_segment_schema, &msg, buffer, len) < 0) {
+            rx->stats.n_malformed++;
+            return;
+        }
+        LPPROF_STOP(LPPROF_LPSIG_UNPACK);
+        if (signal_handle(rx, peer, &msg)) {
+            pending_request(rx, session_find(rx, peer));
+        }
+    } else if (lpc_match(&lpsig_batch_schema, buffer, len)) {
+        lpsig_batch_msg_t msg;
+        bool pending = false;
+        int i;
+
+        LPPROF_START(LPPROF_LPSIG_UNPACK);
+        if (lpc_decode(&lpsig_batch_schema, &msg, buffer, len) < 0) {
+            rx->stats.n_malformed++;
+            return;
+        }
+        LPPROF_STOP(LPPROF_LPSIG_UNPACK);
+        for (i = 0; i < msg.n_entries; i++) {
+            pending |= signal_handle(rx, peer, &msg.entries[i]);
+        }
+        if (pending) {
+            /* One request for all of them */
+            pending_request(rx, session_find(rx, peer));
+        }
+    }
+}
+
+static void timeout_handle(
+    lprx_t *rx,
+    lprx_session_t *s)
+{
+    if (s->state == LPRX_STATE_IDLE) {
+        session_free(rx, s);
+        return;
+    }
+
+    if (s->n_requests_left > 0) {
+        s->n_requests_left--;
+        rx->stats.n_requests++;
+        missing_request(rx, s);
+        timer_set(rx, s, lprr_timeout_ms(s->period_ms, random()));
+        return;
+    }
+
+    lpreq_cancel_msg_t msg = {
+        .packet_id = s->packet_id,
+    };
+
+    message_send(rx, s, &lpreq_cancel_schema, &msg);
+    rx->stats.n_aborted++;
+    reception_end(rx, s);
+}
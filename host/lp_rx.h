@@ -0,0 +1,106 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_RX_H
+#define LP_RX_H
+
+/* Function identifier prefix: lprx_ */
+
+/* Receiver side of the large packet protocol, natively on Linux, for border
+ * routers: listens on a UDP socket, answers signals with requests, reassembles
+ * sub-packets, requests missing ones on time-out, and reports progress, as
+ * large_packet_receive_proc does on a Mira root. The wire format and the rules
+ * of reception are shared with the nodes, see lp_wire.h and lp_rxrules.h.
+ *
+ * Every sender has a session of its own, so that thousands of senders are
+ * served at once. The timers of all sessions are kept in a heap, behind a
+ * single timerfd, and the socket and the timerfd are polled with epoll. A
+ * session ends LPRX_SESSION_TIMEOUT_S after the last reception, meanwhile an
+ * interrupted reception can resume. */
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+/* LPREQ_BATCH_MAX_ENTRIES */
+#include "lp_wire.h"
+
+/* Signals of further large packets, pipelined by a sender behind the ongoing
+ * reception, kept per session. They are all requested in one batch request,
+ * which also acknowledges them, and received in turn. Signals beyond are not
+ * acknowledged, so that the sender repeats them. At most
+ * LPREQ_BATCH_MAX_ENTRIES. */
+#ifndef LPRX_MAX_PENDING_SIGNALS
+#define LPRX_MAX_PENDING_SIGNALS (LPREQ_BATCH_MAX_ENTRIES)
+#endif
+
+/* Lifetime of an idle session, keeping a partial reception for resuming. */
+#ifndef LPRX_SESSION_TIMEOUT_S
+#define LPRX_SESSION_TIMEOUT_S (10 * 60)
+#endif
+
+typedef struct {
+    struct sockaddr_in6 src;
+    uint16_t packet_id;
+    /* Segment of a larger object, see LARGE_PACKET_SEGMENT_MAX_BYTES */
+    uint16_t segment;
+    const uint8_t *payload;
+    uint16_t len;
+} lprx_packet_t;
+
+/* Called with each completely received large packet. The payload is only
+ * valid during the call. */
+typedef void (*lprx_packet_fn_t)(
+    void *ctx,
+    const lprx_packet_t *packet);
+
+typedef struct {
+    uint16_t port; /* to listen on, usually LARGE_PACKET_RX_UDP_PORT */
+    uint16_t period_ms; /* sub-packet period to request */
+    uint32_t max_sessions;
+    /* Senders signaling a large packet are subscribed to for this time (see
+     * lp_subscription.h), 0 to not subscribe. */
+    uint16_t subscription_lifetime_s;
+    lprx_packet_fn_t on_packet;
+    void *ctx;
+} lprx_config_t;
+
+typedef struct {
+    uint32_t n_sessions; /* current */
+    uint32_t n_packets; /* received completely */
+    uint32_t n_resumed;
+    uint32_t n_requests; /* for missing sub-packets, after time-out */
+    uint32_t n_aborted;
+    uint32_t n_rejected; /* signals dropped for lack of session */
+    uint32_t n_malformed; /* datagrams */
+} lprx_stats_t;
+
+typedef struct lprx lprx_t;
+
+/* Open the UDP socket, and create the event loop. Returns NULL on error, with
+ * errno set. */
+lprx_t *lprx_open(
+    const lprx_config_t *config);
+
+/* The epoll file descriptor, readable when lprx_dispatch() has work to do. For
+ * use in the event loop of the application, if any. */
+int lprx_fd(
+    const lprx_t *rx);
+
+/* Wait up to timeout_ms (-1 for ever) for datagrams and timers, and handle
+ * them. Returns 0, or -1 on error, with errno set. */
+int lprx_dispatch(
+    lprx_t *rx,
+    int timeout_ms);
+
+void lprx_stats_get(
+    const lprx_t *rx,
+    lprx_stats_t *stats);
+
+/* Close the socket, and free all sessions. */
+void lprx_close(
+    lprx_t *rx);
+
+#endif
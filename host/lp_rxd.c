@@ -0,0 +1,341 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+
+This example is provided as is, without warranty.
+----------------------------------------------------------------------------*/
+
+/* Receives large packets over UDP on a Linux border router (see lp_rx.h), and
+ * writes each as a binary frame (see lp_frame.h), to stdout or to a Unix
+ * datagram socket, one frame per datagram. The frames are the ones of the Mira
+ * receiver's UART, so that lp_frame_dump reads either:
+ *
+ *     lp_rxd | lp_frame_dump -d packets
+ *
+ * With -w, the large packets are instead written into memory-mapped files of
+ * -W bytes (see lp_sink_mmap.h), one per sender, named after its address and
+ * port in directory dir, at their offset in the object of their segment. Objects
+ * larger than a large packet are so reassembled in the file of their sender.
+ *
+ * Usage: lp_rxd [-p port] [-r period_ms] [-n max_sessions]
+ *               [-s subscription_lifetime_s] [-u socket_path]
+ *               [-w dir [-W file_bytes]]
+ */
+#define _DEFAULT_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lp_frame.h"
+#include "lp_prof.h"
+#include "lp_rx.h"
+#include "lp_sink_mmap.h"
+#include "lp_wire.h"
+
+// ******************************************************************************
+// Module types
+// ******************************************************************************
+/* A whole frame, written to the socket at once */
+typedef struct {
+    uint8_t data[2 * LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS
+        * LARGE_PACKET_SUBPACKET_MAX_BYTES];
+    size_t len;
+    int overflow;
+} frame_buffer_t;
+
+/* The file of a sender, with -w */
+typedef struct {
+    struct sockaddr_in6 src;
+    lpsm_sink_t sink;
+} sender_file_t;
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static volatile sig_atomic_t running = 1;
+static int out_sock = -1;
+static struct sockaddr_un out_addr;
+static frame_buffer_t frame;
+static const char *sink_dir;
+static size_t sink_size = 64 << 20;
+static sender_file_t *sender_files;
+static size_t n_sender_files;
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static void stop(
+    int sig);
+
+static void frame_write(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len);
+
+static void stdout_write(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len);
+
+static void packet_output(
+    void *ctx,
+    const lprx_packet_t *packet);
+
+static lpsm_sink_t *sender_sink_get(
+    const struct sockaddr_in6 *src);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int main(
+    int argc,
+    char *argv[])
+{
+    lprx_config_t config = {
+        .port = LARGE_PACKET_RX_UDP_PORT,
+        .period_ms = 100,
+        .max_sessions = 4096,
+        .subscription_lifetime_s = 0,
+        .on_packet = packet_output,
+        .ctx = NULL,
+    };
+    const char *socket_path = NULL;
+    struct sigaction sa;
+    lprx_stats_t stats;
+    lprx_t *rx;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:r:n:s:u:w:W:")) != -1) {
+        switch (opt) {
+        case 'p':
+            config.port = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            config.period_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            config.max_sessions = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            config.subscription_lifetime_s = strtoul(optarg, NULL, 10);
+            break;
+        case 'u':
+            socket_path = optarg;
+            break;
+        case 'w':
+            sink_dir = optarg;
+            break;
+        case 'W':
+            sink_size = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p port] [-r period_ms] [-n max_sessions] "
+                "[-s subscription_lifetime_s] [-u socket_path] "
+                "[-w dir [-W file_bytes]]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (sink_dir) {
+        struct rlimit rl;
+
+        /* A mapped file per sender */
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+    }
+
+    if (socket_path) {
+        if (strlen(socket_path) >= sizeof(out_addr.sun_path)) {
+            fprintf(stderr, "%s: path too long\n", socket_path);
+            return 1;
+        }
+        out_sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (out_sock < 0) {
+            perror("socket");
+            return 1;
+        }
+        out_addr.sun_family = AF_UNIX;
+        strcpy(out_addr.sun_path, socket_path);
+    }
+
+    srandom(time(NULL) ^ getpid());
+
+    rx = lprx_open(&config);
+    if (rx == NULL) {
+        perror("lprx_open");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (running) {
+        if (lprx_dispatch(rx, -1) < 0) {
+            perror("lprx_dispatch");
+            break;
+        }
+    }
+
+    lprx_stats_get(rx, &stats);
+    fprintf(stderr, "%u packets, %u resumed, %u requests, %u aborted, "
+        "%u rejected, %u malformed, %u sessions\n",
+        stats.n_packets,
+        stats.n_resumed,
+        stats.n_requests,
+        stats.n_aborted,
+        stats.n_rejected,
+        stats.n_malformed,
+        stats.n_sessions);
+#if LP_PROF
+    /* Probes of the receiver engine, built with make LP_PROF=1 */
+    for (int i = 0; i < LPPROF_COUNT; i++) {
+        lpprof_stats_t prof;
+
+        if (lpprof_stats_get(i, &prof) == 0 && prof.n_samples > 0) {
+            fprintf(stderr, "%-16s %8lu samples, %lu/%lu/%lu ns min/mean/max\n",
+                lpprof_name(i),
+                (unsigned long) prof.n_samples,
+                (unsigned long) prof.min_ns,
+                (unsigned long) prof.mean_ns,
+                (unsigned long) prof.max_ns);
+        }
+    }
+#endif
+    lprx_close(rx);
+    if (out_sock >= 0) {
+        close(out_sock);
+    }
+    for (size_t i = 0; i < n_sender_files; i++) {
+        lpsm_close(&sender_files[i].sink);
+    }
+    free(sender_files);
+    return 0;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static void stop(
+    int sig)
+{
+    (void) sig;
+    running = 0;
+}
+
+static void frame_write(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len)
+{
+    frame_buffer_t *f = (frame_buffer_t *) ctx;
+
+    if (f->len + len > sizeof(f->data)) {
+        f->overflow = 1;
+        return;
+    }
+    memcpy(f->data + f->len, data, len);
+    f->len += len;
+}
+
+static void stdout_write(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len)
+{
+    (void) ctx;
+    fwrite(data, 1, len, stdout);
+}
+
+static void packet_output(
+    void *ctx,
+    const lprx_packet_t *packet)
+{
+    const uint8_t *src = packet->src.sin6_addr.s6_addr;
+
+    (void) ctx;
+
+    if (sink_dir) {
+        lpsm_sink_t *sink = sender_sink_get(&packet->src);
+
+        if (sink == NULL
+            || lpsm_write(sink,
+                (uint32_t) packet->segment * LARGE_PACKET_SEGMENT_MAX_BYTES,
+                packet->payload,
+                packet->len) < 0) {
+            fprintf(stderr, "Segment %u of id %u not written, dropped\n",
+                packet->segment,
+                packet->packet_id);
+        }
+        return;
+    }
+
+    if (out_sock < 0) {
+        lpfr_write_large_packet(stdout_write, NULL, src,
+            packet->packet_id, packet->payload, packet->len);
+        fflush(stdout);
+        return;
+    }
+
+    frame.len = 0;
+    frame.overflow = 0;
+    lpfr_write_large_packet(frame_write, &frame, src,
+        packet->packet_id, packet->payload, packet->len);
+    if (frame.overflow) {
+        fprintf(stderr, "Frame too large, id %u dropped\n", packet->packet_id);
+        return;
+    }
+    if (sendto(out_sock, frame.data, frame.len, 0,
+            (const struct sockaddr *) &out_addr, sizeof(out_addr)) < 0) {
+        /* No reader is no reason to stop receiving */
+        fprintf(stderr, "%s: %s\n", out_addr.sun_path, strerror(errno));
+    }
+}
+
+/* The file of sender src, created on its first large packet */
+static lpsm_sink_t *sender_sink_get(
+    const struct sockaddr_in6 *src)
+{
+    char name[INET6_ADDRSTRLEN];
+    char path[PATH_MAX];
+    sender_file_t *files;
+
+    for (size_t i = 0; i < n_sender_files; i++) {
+        if (memcmp(&sender_files[i].src.sin6_addr, &src->sin6_addr,
+                sizeof(src->sin6_addr)) == 0
+            && sender_files[i].src.sin6_port == src->sin6_port) {
+            return &sender_files[i].sink;
+        }
+    }
+
+    files = realloc(sender_files, (n_sender_files + 1) * sizeof(*files));
+    if (files == NULL) {
+        return NULL;
+    }
+    sender_files = files;
+
+    inet_ntop(AF_INET6, &src->sin6_addr, name, sizeof(name));
+    snprintf(path, sizeof(path), "%s/%s_%u.bin", sink_dir, name,
+        ntohs(src->sin6_port));
+    if (lpsm_open(&files[n_sender_files].sink, path, sink_size) < 0) {
+        return NULL;
+    }
+    files[n_sender_files].src = *src;
+
+    return &files[n_sender_files++].sink;
+}
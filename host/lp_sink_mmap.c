@@ -0,0 +1,79 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "lp_sink_mmap.h"
+
+#define DEBUG_LEVEL 2
+#include "utils.h"
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int lpsm_open(
+    lpsm_sink_t *sink,
+    const char *path,
+    size_t size)
+{
+    sink->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (sink->fd < 0) {
+        P_ERR("%s: open %s\n", __func__, path);
+        return -1;
+    }
+
+    if (ftruncate(sink->fd, size) < 0) {
+        P_ERR("%s: ftruncate\n", __func__);
+        close(sink->fd);
+        return -1;
+    }
+
+    sink->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, sink->fd, 0);
+    if (sink->map == MAP_FAILED) {
+        P_ERR("%s: mmap\n", __func__);
+        close(sink->fd);
+        return -1;
+    }
+    sink->size = size;
+
+    return 0;
+}
+
+int lpsm_write(
+    void *ctx,
+    uint32_t offset,
+    const uint8_t *data,
+    uint16_t len)
+{
+    lpsm_sink_t *sink = (lpsm_sink_t *) ctx;
+
+    if ((size_t) offset + len > sink->size) {
+        P_ERR("%s: offset %lu out of file\n", __func__, (unsigned long) offset);
+        return -1;
+    }
+
+    memcpy(sink->map + offset, data, len);
+    return 0;
+}
+
+int lpsm_close(
+    lpsm_sink_t *sink)
+{
+    int ret = 0;
+
+    if (msync(sink->map, sink->size, MS_SYNC) < 0) {
+        P_ERR("%s: msync\n", __func__);
+        ret = -1;
+    }
+    munmap(sink->map, sink->size);
+    close(sink->fd);
+
+    return ret;
+}
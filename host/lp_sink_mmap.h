@@ -0,0 +1,45 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+----------------------------------------------------------------------------*/
+
+#ifndef LP_SINK_MMAP_H
+#define LP_SINK_MMAP_H
+
+/* Function identifier prefix: lpsm_ */
+
+/* Reassembly sink backed by a memory-mapped file, for the Linux host build.
+ * lp_rxd writes the large packets it receives at their offset in the object of
+ * their segment (see LARGE_PACKET_SEGMENT_MAX_BYTES in lp_wire.h). The write
+ * callback has the signature of large_packet_write_fn_t, for use with
+ * large_packet_register_rx_sink(lp, lpsm_write, &sink). */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    int fd;
+    uint8_t *map;
+    size_t size;
+} lpsm_sink_t;
+
+/* Create (or truncate) the file at path to size bytes, and map it. */
+int lpsm_open(
+    lpsm_sink_t *sink,
+    const char *path,
+    size_t size);
+
+/* Write len bytes of data at byte offset offset of the file. ctx is the
+ * lpsm_sink_t. Returns negative if out of the file. */
+int lpsm_write(
+    void *ctx,
+    uint32_t offset,
+    const uint8_t *data,
+    uint16_t len);
+
+/* Flush the mapping to the file, and close it. */
+int lpsm_close(
+    lpsm_sink_t *sink);
+
+#endif
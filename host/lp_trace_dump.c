@@ -0,0 +1,199 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2020 LumenRadio AB
+This code is the property of Lumenradio AB and may not be redistributed in any
+form without prior written permission from LumenRadio AB.
+
+This example is provided as is, without warranty.
+----------------------------------------------------------------------------*/
+
+/* Reads trace frames (see lp_trace.h) from a node's UART (or stdin, e.g. a
+ * capture file), and prints them as a timeline: time since the first record,
+ * time since the previous record, module, event and arguments.
+ *
+ * Usage: lp_trace_dump [device | file]
+ */
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "lp_frame_decoder.h"
+#include "lp_trace.h"
+
+// ******************************************************************************
+// Module constants
+// ******************************************************************************
+static const char *const module_names[LPTR_MODULE_COUNT] = {
+    [LPTR_MODULE_LP] = "lp",
+    [LPTR_MODULE_LPSIG] = "lpsig",
+    [LPTR_MODULE_LPREQ] = "lpreq",
+    [LPTR_MODULE_LPSP] = "lpsp",
+    [LPTR_MODULE_LPACK] = "lpack",
+    [LPTR_MODULE_LPD] = "lpd",
+    [LPTR_MODULE_APP] = "app",
+    [LPTR_MODULE_LPB] = "lpb",
+    [LPTR_MODULE_LPSUB] = "lpsub",
+};
+
+static const char *const event_names[LPTR_EV_COUNT] = {
+    [LPTR_EV_UDP_RX] = "udp_rx",
+    [LPTR_EV_SIGNAL_TX] = "signal_tx",
+    [LPTR_EV_SIGNAL_RX] = "signal_rx",
+    [LPTR_EV_REQUEST_TX] = "request_tx",
+    [LPTR_EV_REQUEST_RX] = "request_rx",
+    [LPTR_EV_CANCEL_TX] = "cancel_tx",
+    [LPTR_EV_CANCEL_RX] = "cancel_rx",
+    [LPTR_EV_ACK_TX] = "ack_tx",
+    [LPTR_EV_ACK_RX] = "ack_rx",
+    [LPTR_EV_SUBPACKET_TX] = "subpacket_tx",
+    [LPTR_EV_SUBPACKET_RX] = "subpacket_rx",
+    [LPTR_EV_SUBPACKET_DROP] = "subpacket_drop",
+    [LPTR_EV_RX_RESUME] = "rx_resume",
+    [LPTR_EV_RX_TIMEOUT] = "rx_timeout",
+    [LPTR_EV_RX_ABORT] = "rx_abort",
+    [LPTR_EV_RX_DONE] = "rx_done",
+    [LPTR_EV_TX_START] = "tx_start",
+    [LPTR_EV_TX_END] = "tx_end",
+    [LPTR_EV_MCAST_ROUND] = "mcast_round",
+    [LPTR_EV_QUEUE_FULL] = "queue_full",
+    [LPTR_EV_BUDGET_WAIT] = "budget_wait",
+    [LPTR_EV_TX_QUEUE_FULL] = "tx_queue_full",
+    [LPTR_EV_ANNOUNCE_END] = "announce_end",
+    [LPTR_EV_SUBSCRIBE_TX] = "subscribe_tx",
+    [LPTR_EV_SUBSCRIBE_RX] = "subscribe_rx",
+};
+
+// ******************************************************************************
+// Module variables
+// ******************************************************************************
+static lpfd_decoder_t decoder;
+static int have_first;
+static uint32_t first_time;
+static uint32_t previous_time;
+static uint16_t previous_n_lost;
+
+// ******************************************************************************
+// Function prototypes
+// ******************************************************************************
+static void packet_ignore(
+    void *ctx,
+    const lpfd_packet_t *packet);
+
+static void trace_frame_print(
+    void *ctx,
+    uint8_t type,
+    const uint8_t *data,
+    size_t len);
+
+static uint32_t load32(
+    const uint8_t *p);
+
+// ******************************************************************************
+// Function definitions
+// ******************************************************************************
+int main(
+    int argc,
+    char *argv[])
+{
+    int fd = STDIN_FILENO;
+
+    if (argc > 1) {
+        fd = open(argv[1], O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    if (isatty(fd)) {
+        struct termios tio;
+
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            cfsetispeed(&tio, B115200);
+            cfsetospeed(&tio, B115200);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+
+    lpfd_init(&decoder, packet_ignore, NULL);
+    lpfd_frame_handler_set(&decoder, trace_frame_print);
+
+    while (1) {
+        uint8_t buf[4096];
+        ssize_t n = read(fd, buf, sizeof(buf));
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        lpfd_feed(&decoder, buf, n);
+    }
+    return 0;
+}
+
+// ******************************************************************************
+// Internal functions
+// ******************************************************************************
+static void packet_ignore(
+    void *ctx,
+    const lpfd_packet_t *packet)
+{
+}
+
+static void trace_frame_print(
+    void *ctx,
+    uint8_t type,
+    const uint8_t *data,
+    size_t len)
+{
+    if (type != LPFR_TYPE_TRACE || len < LPTR_FRAME_HEADER_SIZE - 1) {
+        return;
+    }
+
+    uint16_t ticks_per_s = data[0] | (data[1] << 8);
+    uint16_t n_lost = data[2] | (data[3] << 8);
+
+    if (ticks_per_s == 0) {
+        return;
+    }
+    if (n_lost != previous_n_lost) {
+        printf("--- %u records lost ---\n", (uint16_t) (n_lost - previous_n_lost));
+        previous_n_lost = n_lost;
+    }
+
+    for (const uint8_t *r = data + LPTR_FRAME_HEADER_SIZE - 1;
+         r + LPTR_RECORD_SIZE <= data + len;
+         r += LPTR_RECORD_SIZE) {
+        uint32_t time = load32(r);
+        uint8_t module = r[4];
+        uint8_t event = r[5];
+
+        if (!have_first) {
+            have_first = 1;
+            first_time = time;
+            previous_time = time;
+        }
+
+        printf("%10.3f %+8.3f  %-6s %-15s %5u %10u %10u\n",
+            (double) (time - first_time) / ticks_per_s,
+            (double) (time - previous_time) / ticks_per_s,
+            module < LPTR_MODULE_COUNT ? module_names[module] : "?",
+            event < LPTR_EV_COUNT ? event_names[event] : "?",
+            r[6] | (r[7] << 8),
+            load32(r + 8),
+            load32(r + 12));
+        previous_time = time;
+    }
+    fflush(stdout);
+}
+
+static uint32_t load32(
+    const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
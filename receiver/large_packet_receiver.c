@@ -9,11 +9,18 @@ This example is provided as is, without warranty.
 #include <mira.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "large_packet.h"
+#include "lp_ack.h"
+#include "lp_dispatch.h"
 #include "lp_events.h"
+#include "lp_frame.h"
+#include "lp_prof.h"
 #include "lp_request.h"
 #include "lp_signal.h"
+#include "lp_subscription.h"
+#include "lp_trace.h"
 #include "network_setup.h"
 
 #define DEBUG_LEVEL 2
@@ -31,6 +38,34 @@ This example is provided as is, without warranty.
  * no fill up, depending on the receiver's listening rate. */
 #define SUB_PACKET_PERIOD_REQUEST_MS (800)
 
+/* Lifetime of subscriptions to senders. A sender signaling a large packet is
+ * subscribed to, so that it pushes the next ones. The subscription is renewed
+ * upon the first signal after it expires. */
+#define SUBSCRIPTION_LIFETIME_S (30 * 60)
+
+/* Number of large packets received at the same time, e.g. from different
+ * senders, in turns. An interrupted reception resumes in its slot, see
+ * large_packet_receive_prepare(). Each slot holds a whole large packet in RAM,
+ * about 21 KB. */
+#define LARGE_PACKET_RX_SLOTS (2)
+
+/* Max number of large packets signaled by the sender of the ongoing reception,
+ * pipelined behind it, and received in turn once it ends. They are requested
+ * together, with one batch request. */
+#define MAX_PENDING_SIGNALS (LPREQ_BATCH_MAX_ENTRIES)
+
+/* Signals of a batch signal are posted one at a time: the pending large
+ * packets are requested this long after the first of them, to request them all
+ * in the same batch request. */
+#define PENDING_REQUEST_DELAY_MS (50)
+
+/* Output received large packets as binary frames (see lp_frame.h) on the UART,
+ * instead of as text. The trace (see lp_trace.h) is then output too. Decode on
+ * the host with lp_frame_dump and lp_trace_dump. */
+#ifndef LARGE_PACKET_OUTPUT_FRAMED
+#define LARGE_PACKET_OUTPUT_FRAMED (0)
+#endif
+
 static const mira_net_config_t net_config = {
     .pan_id = PAN_ID,
     .key = ENCRYPTION_KEY,
@@ -51,9 +86,14 @@ MIRA_IODEFS(
 // Module variables
 // ******************************************************************************
 /* +1 for possible extra string termination */
-static uint8_t large_packet_payload_storage[
-    LARGE_PACKET_SUBPACKET_MAX_BYTES * LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS + 1];
-static large_packet_t large_packet_rx;
+static uint8_t large_packet_payload_storage[LARGE_PACKET_RX_SLOTS]
+[LARGE_PACKET_SUBPACKET_MAX_BYTES * LARGE_PACKET_MAX_NUMBER_OF_SUBPACKETS + 1];
+static large_packet_t large_packet_rx[LARGE_PACKET_RX_SLOTS];
+/* Slot of the ongoing reception */
+static large_packet_t *large_packet_rx_current;
+/* Pipelined large packets, in the order they were signaled */
+static lp_event_signaled_data_t pending[MAX_PENDING_SIGNALS];
+static uint8_t n_pending;
 
 // ******************************************************************************
 // Function prototypes
@@ -63,6 +103,19 @@ PROCESS(main_proc, "Main process");
 PROCESS(signal_to_request_proc, "Reply to signal with request process");
 PROCESS(large_packet_monitor_proc, "Monitor incoming large packets");
 
+static bool pending_add(
+    const lp_event_signaled_data_t *signaled_data);
+
+static void pending_request(
+    void);
+
+#if LARGE_PACKET_OUTPUT_FRAMED
+static void uart_frame_write(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len);
+#endif
+
 // ******************************************************************************
 // Function definitions
 // ******************************************************************************
@@ -82,10 +135,12 @@ void mira_setup(
     }
 
     /* Setup large packet storage */
-    large_packet_rx = (large_packet_t) {
-        0
-    };
-    large_packet_rx.payload = large_packet_payload_storage;
+    for (int i = 0; i < LARGE_PACKET_RX_SLOTS; ++i) {
+        large_packet_rx[i] = (large_packet_t) {
+            0
+        };
+        large_packet_rx[i].payload = large_packet_payload_storage[i];
+    }
 
     process_start(&main_proc, NULL);
 }
@@ -103,6 +158,12 @@ PROCESS_THREAD(main_proc, ev, data)
 
     MIRA_RUN_CHECK(mira_net_init(&net_config));
 
+#if LARGE_PACKET_OUTPUT_FRAMED
+    lptr_init(uart_frame_write, stdout);
+#else
+    lptr_init(NULL, NULL);
+#endif
+
     RUN_CHECK(large_packet_init(LARGE_PACKET_RECEIVER));
     process_start(&signal_to_request_proc, NULL);
     process_start(&large_packet_monitor_proc, NULL);
@@ -112,50 +173,119 @@ PROCESS_THREAD(main_proc, ev, data)
 
 PROCESS_THREAD(signal_to_request_proc, ev, data)
 {
+    static lp_event_signaled_data_t signaled_data;
+    static struct etimer request_timer;
+    static bool request_due;
+    /* The large packet is requested already, with the pending ones */
+    bool requested;
+
     PROCESS_BEGIN();
 
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_signaled_ready,
+        NULL,
+        LPD_ANY_PACKET_ID));
+
     while (1) {
-        PROCESS_WAIT_EVENT_UNTIL(ev == event_lp_signaled_ready);
-        lp_event_signaled_data_t signaled_data = *(lp_event_signaled_data_t *) data;
+        PROCESS_WAIT_EVENT_UNTIL(
+            ev == event_lp_signaled_ready
+            || (ev == PROCESS_EVENT_EXITED && data == &large_packet_receive_proc)
+            || (request_due && etimer_expired(&request_timer)));
+
+        if (ev == event_lp_signaled_ready) {
+            signaled_data = *(lp_event_signaled_data_t *) data;
+            requested = false;
+
+            if (!signaled_data.push
+                && process_is_running(&large_packet_receive_proc)
+                && signaled_data.packet_id != large_packet_rx_current->id
+                && memcmp(
+                    &signaled_data.src,
+                    &large_packet_rx_current->node_addr,
+                    sizeof(mira_net_address_t)) == 0
+            ) {
+                /* Next large packet, pipelined by the sender behind the ongoing
+                 * reception. Received as soon as the ongoing reception ends,
+                 * instead of dropped. The request acknowledges the signal. */
+                if (pending_add(&signaled_data) && !request_due) {
+                    etimer_set(
+                        &request_timer,
+                        PENDING_REQUEST_DELAY_MS * CLOCK_SECOND / 1000);
+                    request_due = true;
+                }
+                continue;
+            }
+        } else if (ev == PROCESS_EVENT_EXITED
+                   && data == &large_packet_receive_proc) {
+            if (n_pending == 0) {
+                continue;
+            }
+            /* The next pipelined large packet, requested with the others
+             * unless their request is still due */
+            signaled_data = pending[0];
+            n_pending--;
+            memmove(&pending[0], &pending[1], n_pending * sizeof(pending[0]));
+            requested = !request_due;
+        } else {
+            request_due = false;
+            pending_request();
+            continue;
+        }
 
         /* This example always replies to signal with an immediate request. If
          * there is need to schedule requests of large packets in a smarter way,
          * here would be the place to do it. */
 
-        /* Request the whole large packet. */
+        /* Request the whole large packet, or only its missing sub-packets if
+         * a previous reception of it was interrupted. */
         static uint64_t mask;
 
         int ret;
-        ret = large_packet_send_whole_mask_get(&mask, signaled_data.n_sub_packets);
+        ret = large_packet_receive_prepare(
+            large_packet_rx,
+            LARGE_PACKET_RX_SLOTS,
+            &signaled_data.src,
+            signaled_data.src_port,
+            signaled_data.packet_id,
+            signaled_data.n_sub_packets,
+            signaled_data.segment,
+            signaled_data.push && !signaled_data.subscribed
+            ? LARGE_PACKET_PUSH_PERIOD_MS
+            : SUB_PACKET_PERIOD_REQUEST_MS,
+            &large_packet_rx_current,
+            &mask);
 
         if (ret < 0) {
-            P_ERR("%s: could not get mask for large packet\n", __func__);
+            P_ERR("%s: could not prepare for large packet\n", __func__);
             continue;
         }
 
-        /* Setting up for reception */
-        large_packet_rx = (large_packet_t) {
-            .node_addr = signaled_data.src,
-            .node_port = signaled_data.src_port,
-            .payload = large_packet_payload_storage,
-            .len = 0,
-            .id = signaled_data.packet_id,
-            .period_ms = SUB_PACKET_PERIOD_REQUEST_MS,
-            .mask = 0, /* bit at 1 means sub-packet received */
-            .num_sub_packets = signaled_data.n_sub_packets
-        };
-
-        /* Send request for sub-packets, back to the signaling node */
-        RUN_CHECK(lpreq_send(
-            &signaled_data.src,
-            signaled_data.src_port,
-            signaled_data.packet_id,
-            mask,
-            SUB_PACKET_PERIOD_REQUEST_MS));
+        if (!signaled_data.push && !requested) {
+            /* Send request for sub-packets, back to the signaling node */
+            RUN_CHECK(lpreq_send(
+                &signaled_data.src,
+                signaled_data.src_port,
+                signaled_data.packet_id,
+                mask,
+                SUB_PACKET_PERIOD_REQUEST_MS,
+                large_packet_rx_current->session));
+        }
+        /* else sub-packets are already on their way, pushed, or requested
+         * with the other pending large packets. Missing ones are requested on
+         * time-out. */
+
+        if (!signaled_data.subscribed) {
+            /* Have the sender push its next large packets */
+            RUN_CHECK(lpsub_send(
+                &signaled_data.src,
+                signaled_data.src_port,
+                SUB_PACKET_PERIOD_REQUEST_MS,
+                SUBSCRIPTION_LIFETIME_S));
+        }
 
-        /* Start or restart sub-packet rx monitor */
-        process_exit(&large_packet_receive_proc);
-        process_start(&large_packet_receive_proc, &large_packet_rx);
+        /* Start sub-packet rx monitor, stopped by the preparation above */
+        process_start(&large_packet_receive_proc, large_packet_rx_current);
     }
 
     PROCESS_END();
@@ -165,12 +295,102 @@ PROCESS_THREAD(large_packet_monitor_proc, ev, data)
 {
     PROCESS_BEGIN();
 
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_received,
+        NULL,
+        LPD_ANY_PACKET_ID));
+
     while (1) {
         PROCESS_WAIT_EVENT_UNTIL(ev == event_lp_received);
-        printf("Large packet received, %d bytes\n", large_packet_rx.len);
-        large_packet_rx.payload[large_packet_rx.len] = '\0';
-        printf("%s\n", large_packet_rx.payload);
+        large_packet_t *lp = (large_packet_t *) data;
+
+        if (lp->payload == NULL) {
+            /* Received into a sink (see large_packet_register_rx_sink()),
+             * nothing to output from RAM */
+#if !LARGE_PACKET_OUTPUT_FRAMED
+            printf("Large packet received into sink, %d bytes, segment %d\n",
+                lp->len,
+                lp->segment);
+#endif
+            continue;
+        }
+
+#if LARGE_PACKET_OUTPUT_FRAMED
+        /* Straight from the reassembly buffer, no copy or formatting */
+        lpfr_write_large_packet(
+            uart_frame_write,
+            stdout,
+            (const uint8_t *) &lp->node_addr,
+            lp->id,
+            lp->payload,
+            lp->len);
+#else
+        printf("Large packet received, %d bytes\n", lp->len);
+        lp->payload[lp->len] = '\0';
+        printf("%s\n", lp->payload);
+#if LP_PROF
+        lpprof_print();
+#endif
+#endif
     }
 
     PROCESS_END();
 }
+
+/* Queue a pipelined large packet, unless queued already. Returns false if
+ * the queue is full: the sender signals the large packet again later. */
+static bool pending_add(
+    const lp_event_signaled_data_t *signaled_data)
+{
+    for (int i = 0; i < n_pending; ++i) {
+        if (pending[i].packet_id == signaled_data->packet_id) {
+            /* Signaled again, the request was lost */
+            pending[i] = *signaled_data;
+            return true;
+        }
+    }
+
+    if (n_pending == MAX_PENDING_SIGNALS) {
+        return false;
+    }
+    pending[n_pending++] = *signaled_data;
+    return true;
+}
+
+/* Request all pending large packets from their sender, in one batch request,
+ * each with the mask of its number of sub-packets. */
+static void pending_request(
+    void)
+{
+    lpreq_entry_t entries[MAX_PENDING_SIGNALS];
+
+    if (n_pending == 0) {
+        return;
+    }
+
+    for (int i = 0; i < n_pending; ++i) {
+        entries[i].packet_id = pending[i].packet_id;
+        RUN_CHECK(large_packet_send_whole_mask_get(
+            &entries[i].sub_packet_mask,
+            pending[i].n_sub_packets));
+    }
+
+    RUN_CHECK(lpreq_batch_send(
+        &pending[0].src,
+        pending[0].src_port,
+        entries,
+        n_pending,
+        SUB_PACKET_PERIOD_REQUEST_MS));
+}
+
+#if LARGE_PACKET_OUTPUT_FRAMED
+static void uart_frame_write(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len)
+{
+    fwrite(data, 1, len, (FILE *) ctx);
+    fflush((FILE *) ctx);
+}
+#endif
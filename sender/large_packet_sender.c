@@ -12,8 +12,9 @@ This example is provided as is, without warranty.
 #include <string.h>
 
 #include "large_packet.h"
+#include "lp_dispatch.h"
 #include "lp_events.h"
-#include "lp_signal.h"
+#include "lp_trace.h"
 #include "network_setup.h"
 
 #define DEBUG_LEVEL 2
@@ -32,7 +33,21 @@ static const mira_net_config_t net_config = {
     .prefix = NULL /* default prefix */
 };
 
-static large_packet_t large_packet_tx;
+/*
+ * Large packets in transfer: the ongoing one, and the next ones, announced
+ * together and pipelined behind it (see large_packet_announce_batch()). A slot
+ * is busy from registration until event_lp_sent for its large packet. Requests
+ * for pipelined large packets, coming while the ongoing transfer waits for its
+ * completion, are kept in their slots until the transfer ends, and served in
+ * the order of the packet ids.
+ */
+#define MAX_TRANSFERS (1 + LPSIG_BATCH_MAX_ENTRIES)
+
+static large_packet_t large_packet_tx[MAX_TRANSFERS];
+static bool large_packet_tx_busy[MAX_TRANSFERS];
+static bool large_packet_tx_requested[MAX_TRANSFERS];
+/* Slot of the ongoing transfer, or -1 */
+static int tx_slot_sending = -1;
 
 /*
  * How often to check if we have access to root.
@@ -51,9 +66,23 @@ static large_packet_t large_packet_tx;
 #define PACKET_GENERATION_PERIOD_S (3 * 60)
 
 /*
- * Large packet to send.
+ * Max number of generated packets waiting for transmission.
+ */
+#define MAX_QUEUED_PACKETS (4)
+
+/*
+ * Output the binary trace (see lp_trace.h) on the UART, among the text output.
+ * Decode on the host with lp_trace_dump.
  */
-static uint8_t packet_content[] =
+#ifndef LARGE_PACKET_TRACE_OUTPUT
+#define LARGE_PACKET_TRACE_OUTPUT (0)
+#endif
+
+/*
+ * Large packet to send. Kept in flash, and read one sub-packet at a time when
+ * sending (see packet_content_read()).
+ */
+static const uint8_t packet_content[] =
     "Lorem ipsum dolor sit amet, consectetaur adipisicing elit, sed do eiusmod tempor"
     "incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis"
     "nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo"
@@ -165,6 +194,34 @@ PROCESS(main_proc, "Main process");
 PROCESS(packet_ready_notify_proc, "Announce packet ready");
 PROCESS(reply_to_request_proc, "React to requests");
 
+static int packet_content_read(
+    void *ctx,
+    uint8_t sub_packet_index,
+    uint8_t *buffer,
+    uint16_t len);
+
+static int tx_slot_free_get(
+    void);
+
+static int tx_slots_n_busy(
+    void);
+
+static int tx_slot_announced_get(
+    void);
+
+static int tx_slot_requested_get(
+    void);
+
+static void tx_slot_send(
+    int slot);
+
+#if LARGE_PACKET_TRACE_OUTPUT
+static void uart_trace_write(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len);
+#endif
+
 void mira_setup(
     void)
 {
@@ -200,11 +257,18 @@ PROCESS_THREAD(main_proc, ev, data)
 
     MIRA_RUN_CHECK(mira_net_init(&net_config));
 
-    process_start(&packet_ready_notify_proc, NULL);
-    process_start(&reply_to_request_proc, NULL);
+#if LARGE_PACKET_TRACE_OUTPUT
+    lptr_init(uart_trace_write, stdout);
+#else
+    lptr_init(NULL, NULL);
+#endif
 
+    /* Before starting processes, which subscribe to large packet events */
     RUN_CHECK(large_packet_init(LARGE_PACKET_SENDER));
 
+    process_start(&packet_ready_notify_proc, NULL);
+    process_start(&reply_to_request_proc, NULL);
+
     PROCESS_END();
 }
 
@@ -214,15 +278,43 @@ PROCESS_THREAD(main_proc, ev, data)
 PROCESS_THREAD(packet_ready_notify_proc, ev, data)
 {
     static struct etimer timer;
+    static struct etimer generation_timer;
     static mira_net_address_t net_address;
     static uint16_t packet_id = 0;
+    static int packets_queued;
+    /* Subscription of the root, if any */
+    static lp_event_subscribed_data_t subscription;
+    static clock_time_t subscribed_at;
 
     static bool route_established;
 
     char buffer[MIRA_NET_MAX_ADDRESS_STR_LEN];
     mira_status_t res;
+    int slot;
+    bool subscribed;
+    bool announcing;
+    /* Large packets to announce together */
+    large_packet_t *announced[LPSIG_BATCH_MAX_ENTRIES];
+    uint8_t n_announced;
+    /* Small packets are pushed, and not pipelined */
+    const bool push = large_packet_n_sub_packets_get(sizeof(packet_content))
+                      <= LARGE_PACKET_PUSH_MAX_SUB_PACKETS;
 
     PROCESS_BEGIN();
+
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_sent,
+        NULL,
+        LPD_ANY_PACKET_ID));
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_subscribed,
+        NULL,
+        LPD_ANY_PACKET_ID));
+
+    subscription.lifetime_s = 0;
+
     PROCESS_PAUSE();
 
     while (1) {
@@ -241,32 +333,118 @@ PROCESS_THREAD(packet_ready_notify_proc, ev, data)
                 etimer_set(&timer, ESTABLISHING_ROUTE_DELAY_S * CLOCK_SECOND);
                 PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
                 route_established = true;
+
+                /* First packet right away, then one every generation period */
+                if (packets_queued == 0) {
+                    packets_queued = 1;
+                }
+                etimer_set(
+                    &generation_timer,
+                    PACKET_GENERATION_PERIOD_S * CLOCK_SECOND);
             }
-            P_DEBUG("Sending packet ready notification to %s\n",
-                mira_net_toolkit_format_address(buffer, &net_address));
-
-            /* Sets the content of the large packet to send */
-            int ret = large_packet_register_tx(
-                &large_packet_tx,
-                packet_id,
-                packet_content,
-                sizeof(packet_content));
-
-            if (ret < 0) {
-                P_ERR("%s: could not register packet %d\n", __func__, packet_id);
-            } else {
-                /* Send signal about the new packet */
-                RUN_CHECK(lpsig_send(
-                    &net_address,
+
+            subscribed = clock_time() - subscribed_at
+                         < (clock_time_t) subscription.lifetime_s * CLOCK_SECOND;
+
+            /* Announce the queued packets together, possibly pipelined
+             * behind the ongoing transfer, once the previous announcement got
+             * its replies. Pushed packets are not pipelined. */
+            announcing = tx_slot_announced_get() >= 0;
+            n_announced = 0;
+            while (packets_queued > 0
+                   && (slot = tx_slot_free_get()) >= 0
+                   && ((push || subscribed)
+                       ? tx_slots_n_busy() == 0
+                       : !announcing && n_announced < LPSIG_BATCH_MAX_ENTRIES)
+            ) {
+                P_DEBUG("Sending packet ready notification to %s\n",
+                    mira_net_toolkit_format_address(buffer, &net_address));
+
+                /* Sets the content of the large packet to send */
+                int ret = large_packet_register_tx_source(
+                    &large_packet_tx[slot],
                     packet_id,
-                    large_packet_n_sub_packets_get(sizeof(packet_content))));
+                    sizeof(packet_content),
+                    packet_content_read,
+                    NULL);
+
+                if (ret < 0) {
+                    P_ERR("%s: could not register packet %d\n", __func__, packet_id);
+                } else if (subscribed) {
+                    /* The root subscribed: no signal and request round trip */
+                    ret = large_packet_push_subscribed(
+                        &large_packet_tx[slot],
+                        &subscription.src,
+                        subscription.period_ms);
+                    tx_slot_sending = ret >= 0 ? slot : -1;
+                } else if (push) {
+                    /* Small packet: skip the request round trip */
+                    ret = large_packet_push(&large_packet_tx[slot], &net_address);
+                    tx_slot_sending = ret >= 0 ? slot : -1;
+                } else {
+                    /* Signaled below, with the other queued packets */
+                    announced[n_announced++] = &large_packet_tx[slot];
+                }
+
+                large_packet_tx_busy[slot] = ret >= 0;
+                large_packet_tx_requested[slot] = false;
+                packets_queued--;
+                packet_id++;
             }
 
-            /* Wait until time for next packet generation */
-            etimer_set(&timer, PACKET_GENERATION_PERIOD_S * CLOCK_SECOND);
-            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+            if (n_announced > 0) {
+                /* One signal for all of them, until requested */
+                RUN_CHECK(large_packet_announce_batch(
+                    announced,
+                    n_announced,
+                    &net_address));
+            }
 
-            packet_id++;
+            /* Wait until time for next packet generation, or until the ongoing
+             * transfer ends, to send the next queued packet without delay. */
+            PROCESS_WAIT_EVENT_UNTIL(
+                etimer_expired(&generation_timer)
+                || ev == event_lp_sent
+                || ev == event_lp_subscribed);
+
+            if (ev == event_lp_sent) {
+                lp_event_sent_data_t *sent_data = (lp_event_sent_data_t *) data;
+                for (slot = 0; slot < MAX_TRANSFERS; slot++) {
+                    if (large_packet_tx_busy[slot]
+                        && large_packet_tx[slot].id == sent_data->packet_id
+                    ) {
+                        P_DEBUG("Packet %d transfer ended, %s\n",
+                            sent_data->packet_id,
+                            sent_data->completed ? "completed" : "not completed");
+                        large_packet_tx_busy[slot] = false;
+                        large_packet_tx_requested[slot] = false;
+                        if (slot == tx_slot_sending) {
+                            tx_slot_sending = -1;
+                        }
+                    }
+                }
+
+                /* The next pipelined large packet, if already requested */
+                if (tx_slot_sending < 0
+                    && (slot = tx_slot_requested_get()) >= 0
+                ) {
+                    large_packet_tx_requested[slot] = false;
+                    tx_slot_send(slot);
+                }
+            } else if (ev == event_lp_subscribed) {
+                subscription = *(lp_event_subscribed_data_t *) data;
+                subscribed_at = clock_time();
+                P_DEBUG("Subscription for %d s\n", subscription.lifetime_s);
+            } else {
+                /* Slots in transfer are left to end, with event_lp_sent. The
+                 * new packet waits for a free slot. */
+                if (packets_queued < MAX_QUEUED_PACKETS) {
+                    packets_queued++;
+                } else {
+                    P_DEBUG("Packet queue full, packet not generated\n");
+                }
+                etimer_reset(&generation_timer);
+            }
         }
     }
 
@@ -276,21 +454,162 @@ PROCESS_THREAD(packet_ready_notify_proc, ev, data)
 PROCESS_THREAD(reply_to_request_proc, ev, data)
 {
     PROCESS_BEGIN();
+
+    RUN_CHECK(lpd_subscribe(
+        PROCESS_CURRENT(),
+        event_lp_requested,
+        NULL,
+        LPD_ANY_PACKET_ID));
     while (1) {
         PROCESS_WAIT_EVENT_UNTIL(ev == event_lp_requested);
         lp_event_requested_data_t req_data = *(lp_event_requested_data_t *) data;
+        large_packet_t *lp = NULL;
+        int slot;
+
+        /* This example replies to requests by starting sending the requested
+         * large packet, right away, or once the ongoing transfer ends. If in
+         * need of a smarter behavior, here is the place to do it. */
+        for (slot = 0; slot < MAX_TRANSFERS; slot++) {
+            if (large_packet_tx_busy[slot]
+                && large_packet_tx[slot].id == req_data.packet_id
+            ) {
+                lp = &large_packet_tx[slot];
+                break;
+            }
+        }
+        if (lp == NULL) {
+            P_DEBUG("Request for packet %d, not in transfer\n", req_data.packet_id);
+            continue;
+        }
 
-        /* This example replies to requests by immediately starting sending the
-         * latest registered large packet. If in need of a smarter behavior,
-         * here is the place to do it. */
+        lp->node_addr = req_data.src;
+        lp->node_port = req_data.src_port;
+        lp->mask = req_data.mask;
+        lp->period_ms = req_data.period_ms;
+        lp->session = req_data.session;
+
+        if (slot == tx_slot_sending) {
+            /* Missing sub-packets, or a push the receiver requests again */
+            RUN_CHECK(large_packet_send(lp));
+        } else if (tx_slot_sending >= 0) {
+            /* Pipelined: sent once the ongoing transfer ends */
+            P_DEBUG("Request for packet %d, queued\n", req_data.packet_id);
+            large_packet_tx_requested[slot] = true;
+        } else {
+            tx_slot_send(slot);
+        }
+    }
+    PROCESS_END();
+}
 
-        large_packet_tx.node_addr = req_data.src;
-        large_packet_tx.node_port = req_data.src_port;
-        large_packet_tx.id = req_data.packet_id;
-        large_packet_tx.mask = req_data.mask;
-        large_packet_tx.period_ms = req_data.period_ms;
+static int packet_content_read(
+    void *ctx,
+    uint8_t sub_packet_index,
+    uint8_t *buffer,
+    uint16_t len)
+{
+    uint32_t offset = sub_packet_index * LARGE_PACKET_SUBPACKET_MAX_BYTES;
 
-        RUN_CHECK(large_packet_send(&large_packet_tx));
+    if (offset + len > sizeof(packet_content)) {
+        return -1;
     }
-    PROCESS_END();
+
+    memcpy(buffer, packet_content + offset, len);
+    return 0;
+}
+
+/*
+ * Index of a large packet slot not in transfer, or -1 if none.
+ */
+static int tx_slot_free_get(
+    void)
+{
+    for (int slot = 0; slot < MAX_TRANSFERS; slot++) {
+        if (!large_packet_tx_busy[slot]) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Number of large packets in transfer.
+ */
+static int tx_slots_n_busy(
+    void)
+{
+    int n_busy = 0;
+
+    for (int slot = 0; slot < MAX_TRANSFERS; slot++) {
+        n_busy += large_packet_tx_busy[slot];
+    }
+    return n_busy;
+}
+
+/*
+ * Index of a large packet slot signaled and waiting for a request, or -1 if
+ * none. Only one announcement, of one or several slots, runs at a time (see
+ * large_packet_announce_batch()).
+ */
+static int tx_slot_announced_get(
+    void)
+{
+    for (int slot = 0; slot < MAX_TRANSFERS; slot++) {
+        if (large_packet_tx_busy[slot]
+            && !large_packet_tx_requested[slot]
+            && slot != tx_slot_sending
+        ) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Index of the large packet slot requested and waiting for the ongoing transfer
+ * to end, with the oldest packet id, or -1 if none. The receiver expects
+ * pipelined large packets in the order they were signaled.
+ */
+static int tx_slot_requested_get(
+    void)
+{
+    int requested = -1;
+
+    for (int slot = 0; slot < MAX_TRANSFERS; slot++) {
+        if (large_packet_tx_busy[slot]
+            && large_packet_tx_requested[slot]
+            && (requested < 0
+                || (int16_t) (large_packet_tx[slot].id
+                              - large_packet_tx[requested].id) < 0)
+        ) {
+            requested = slot;
+        }
+    }
+    return requested;
+}
+
+/*
+ * Start the transfer of the requested large packet of a slot. The slot is
+ * released if it cannot start.
+ */
+static void tx_slot_send(
+    int slot)
+{
+    if (large_packet_send(&large_packet_tx[slot]) < 0) {
+        P_ERR("%s: could not send packet %d\n", __func__, large_packet_tx[slot].id);
+        large_packet_tx_busy[slot] = false;
+        return;
+    }
+    tx_slot_sending = slot;
+}
+
+#if LARGE_PACKET_TRACE_OUTPUT
+static void uart_trace_write(
+    void *ctx,
+    const uint8_t *data,
+    uint16_t len)
+{
+    fwrite(data, 1, len, (FILE *) ctx);
+    fflush((FILE *) ctx);
 }
+#endif